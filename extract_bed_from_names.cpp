@@ -16,16 +16,24 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
- *  g++ -Wall -g utils_io.cpp extract_bed_from_names.cpp -lgsl -lgslcblas -lz -o extract_bed_from_names
+ *  g++ -Wall -g -std=c++11 -pthread utils_io.cpp extract_bed_from_names.cpp -lz -o extract_bed_from_names
  */
 
 #include <cmath>
 #include <ctime>
+#include <cstring>
 #include <getopt.h>
+#include <libgen.h>
 
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 using namespace std;
 
 #include "utils_io.hpp"
@@ -40,7 +48,10 @@ using namespace utils;
 void help(char ** argv)
 {
   cout << "`" << argv[0] << "'"
-       << " extracts a list of BED records based on their names." << endl
+       << " extracts a list of BED records based on their names," << endl
+       << "and/or on the regions they overlap, possibly into one file per group"
+       << endl
+       << "of names in a single pass." << endl
        << endl
        << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
        << endl
@@ -49,8 +60,29 @@ void help(char ** argv)
        << "  -V, --version\toutput version information and exit" << endl
        << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
        << "      --names\tfile with one record name per line" << endl
+       << "      --compact\tkeep the names in a static set taking a few bytes"
+       << endl
+       << "\t\tper name on top of the names, for very long lists" << endl
+       << "      --bloom\tbits per name of a Bloom filter put before the set of"
+       << endl
+       << "\t\t--compact (eg. 10), when most records aren't in the list" << endl
+       << "      --groups\tfile with one record name and one group per line"
+       << endl
+       << "\t\ta name may be in several groups, its records going to each"
+       << endl
+       << "\t\tof them, instead of --names" << endl
+       << "      --regions\tfile with one region per line (BED-like)" << endl
+       << "\t\tthe input should then be sorted and in the BGZF format," << endl
+       << "\t\tits index (<in>.tbi) being built if necessary" << endl
        << "      --in\tinput BED file" << endl
-       << "      --out\toutput BED file (gzipped)" << endl
+       << "      --out\toutput BED file (gzipped, in the BGZF format)" << endl
+       << "\t\twith --groups, prefix of the output files, as <out><group>.bed.gz"
+       << endl
+       << "      --threads\tnumber of threads (default=1)" << endl
+       << "\t\tused to filter the records by chunks, to compress the output,"
+       << endl
+       << "\t\tand to decompress the input if it is in the BGZF format" << endl
+       << "\t\tthe output is the same whatever the number of threads" << endl
     ;
 }
 /** \brief Display version and license information on stdout.
@@ -74,8 +106,13 @@ void parseCmdLine(
   int argc,
   char ** argv,
   string & namesFile,
+  string & groupsFile,
+  string & regionsFile,
   string & inBedFile,
   string & outBedFile,
+  bool & isCompact,
+  size_t & bloomBits,
+  size_t & nbThreads,
   int & verbose)
 {
   int c = 0;
@@ -87,8 +124,13 @@ void parseCmdLine(
       {"version", no_argument, 0, 'V'},
       {"verbose", required_argument, 0, 'v'},
       {"names", required_argument, 0, 0},
+      {"groups", required_argument, 0, 0},
+      {"regions", required_argument, 0, 0},
       {"in", required_argument, 0, 0},
       {"out", required_argument, 0, 0},
+      {"compact", no_argument, 0, 0},
+      {"bloom", required_argument, 0, 0},
+      {"threads", required_argument, 0, 0},
       {0, 0, 0, 0}
     };
     int option_index = 0;
@@ -106,6 +148,16 @@ void parseCmdLine(
         namesFile = optarg;
         break;
       }
+      if(strcmp(long_options[option_index].name, "groups") == 0)
+      {
+        groupsFile = optarg;
+        break;
+      }
+      if(strcmp(long_options[option_index].name, "regions") == 0)
+      {
+        regionsFile = optarg;
+        break;
+      }
       if(strcmp(long_options[option_index].name, "in") == 0)
       {
         inBedFile = optarg;
@@ -116,6 +168,21 @@ void parseCmdLine(
         outBedFile = optarg;
         break;
       }
+      if(strcmp(long_options[option_index].name, "compact") == 0)
+      {
+        isCompact = true;
+        break;
+      }
+      if(strcmp(long_options[option_index].name, "bloom") == 0)
+      {
+        bloomBits = atol(optarg);
+        break;
+      }
+      if(strcmp(long_options[option_index].name, "threads") == 0)
+      {
+        nbThreads = atol(optarg);
+        break;
+      }
     case 'h':
       help(argv);
       exit(0);
@@ -133,20 +200,55 @@ void parseCmdLine(
       abort();
     }
   }
-  if(namesFile.empty())
+  if(namesFile.empty() && groupsFile.empty() && regionsFile.empty())
+  {
+    getCmdLine(argc, argv);
+    fprintf(stderr, "ERROR: missing compulsory option --names, --groups and/or --regions\n\n");
+    help(argv);
+    exit(1);
+  }
+  if(! namesFile.empty() && ! groupsFile.empty())
   {
     getCmdLine(argc, argv);
-    fprintf(stderr, "ERROR: missing compulsory option --names\n\n");
+    fprintf(stderr, "ERROR: --names and --groups can't be used together\n\n");
     help(argv);
     exit(1);
   }
-  if(! doesFileExist(namesFile))
+  if((isCompact || bloomBits > 0) && namesFile.empty())
+  {
+    getCmdLine(argc, argv);
+    fprintf(stderr, "ERROR: --compact and --bloom require --names\n\n");
+    help(argv);
+    exit(1);
+  }
+  if(bloomBits > 0 && ! isCompact)
+  {
+    getCmdLine(argc, argv);
+    fprintf(stderr, "ERROR: --bloom requires --compact\n\n");
+    help(argv);
+    exit(1);
+  }
+  if(! groupsFile.empty() && ! doesFileExist(groupsFile))
+  {
+    getCmdLine(argc, argv);
+    fprintf(stderr, "ERROR: can't find '%s'\n\n", groupsFile.c_str());
+    help(argv);
+    exit(1);
+  }
+  if(! namesFile.empty() && ! doesFileExist(namesFile))
   {
     getCmdLine(argc, argv);
     fprintf(stderr, "ERROR: can't find '%s'\n\n", namesFile.c_str());
     help(argv);
     exit(1);
   }
+  if(! regionsFile.empty() && ! doesFileExist(regionsFile))
+  {
+    getCmdLine(argc, argv);
+    fprintf(stderr, "ERROR: can't find '%s'\n\n", regionsFile.c_str());
+    help(argv);
+    exit(1);
+  }
   if(inBedFile.empty())
   {
     getCmdLine(argc, argv);
@@ -161,6 +263,14 @@ void parseCmdLine(
     help(argv);
     exit(1);
   }
+  if(! regionsFile.empty() && ! isBgzf(inBedFile))
+  {
+    getCmdLine(argc, argv);
+    fprintf(stderr, "ERROR: with --regions, '%s' should be in the BGZF format (eg. sort it, then compress it with bgzip)\n\n",
+            inBedFile.c_str());
+    help(argv);
+    exit(1);
+  }
   if(outBedFile.empty())
   {
     getCmdLine(argc, argv);
@@ -168,91 +278,525 @@ void parseCmdLine(
     help(argv);
     exit(1);
   }
+  if(nbThreads == 0)
+  {
+    getCmdLine(argc, argv);
+    fprintf(stderr, "ERROR: --threads should be at least 1\n\n");
+    help(argv);
+    exit(1);
+  }
 }
 
+/** \brief The names, and the outputs their records go to: the single one
+ *  with --names, or those of their groups with --groups.
+ *  \note With --compact, the names are only in the set, as name 0.
+ */
+struct NameGroups
+{
+  bool isCompact;
+  StringSet set;
+  StringIndex names;
+  vector<size_t> firsts; // outputs of name i in ids[firsts[i]..firsts[i+1])
+  vector<uint32_t> ids;
+  vector<string> groups; // empty with --names
+  
+  NameGroups() : isCompact(false) {}
+  
+  /** \brief Return the id of the name, or StringIndex::npos if it isn't
+   *  one of the names.
+   */
+  size_t find(const char * s, const size_t & len) const {
+    if(isCompact)
+      return set.contains(s, len) ? 0 : StringIndex::npos;
+    return names.find(s, len);
+  }
+};
+
+/** \brief Load the names in a hash set, so that looking up any BED record
+ *  takes the same time however many names there are.
+ *  \note With --compact, a static set is built once all names are read,
+ *  about 3 bytes per name (plus bloomBits / 8) instead of about 20.
+ */
 void loadNames(
   const string & namesFile,
+  const bool & isCompact,
+  const size_t & bloomBits,
   const int & verbose,
-  vector<string> & names)
+  NameGroups & names)
 {
   if(verbose > 0)
     cout << "load names from file " << namesFile << " ..." << endl;
   
-  gzFile stream;
-  vector<string> tokens;
-  string line;
-  openFile(namesFile, stream, "rb");
-  while(getline(stream, line)){
-    split(line, " \t", tokens);
-    if(find(names.begin(), names.end(), tokens[0]) == names.end())
-      names.push_back(tokens[0]);
-  }
-  if(! gzeof(stream)){
-    cerr << "ERROR: can't read successfully file "
-	 << namesFile << " up to the end" << endl;
-    exit(1);
+  LineReader reader(namesFile);
+  Field name;
+  const char * line;
+  size_t len;
+  bool isNew;
+  while(reader.getline(line, len)){
+    if(! findToken(line, len, DELIMS_WHITESPACE, 0, name))
+      continue;
+    if(isCompact)
+      names.set.add(line + name.off, name.len);
+    else
+      names.names.insert(line + name.off, name.len, isNew);
+  }
+  reader.close();
+  
+  names.isCompact = isCompact;
+  size_t nbNames = names.names.size();
+  if(isCompact){
+    names.set.build(bloomBits);
+    nbNames = names.set.size();
+  }
+  for(size_t i = 0; i <= (isCompact ? 1 : nbNames); ++i)
+    names.firsts.push_back(i);
+  names.ids.assign(isCompact ? 1 : nbNames, 0);
+  
+  if (verbose > 0)
+    cout << "nb of names: " << nbNames << endl;
+  if(isCompact && verbose > 1)
+    cout << "memory of the set: " << names.set.memory() << " bytes" << endl;
+}
+
+/** \brief Load the names and their groups, a name being possibly in several
+ *  groups, so that the groups of any BED record are found with one lookup.
+ */
+void loadGroups(
+  const string & groupsFile,
+  const int & verbose,
+  NameGroups & names)
+{
+  if(verbose > 0)
+    cout << "load names and groups from file " << groupsFile << " ..." << endl;
+  
+  LineReader reader(groupsFile);
+  StringIndex groups;
+  vector<pair<size_t, uint32_t> > pairs; // name, group
+  Field fields[2];
+  const char * line;
+  size_t len;
+  bool isNew;
+  while(reader.getline(line, len)){
+    size_t nbFields = tokenize(line, len, DELIMS_WHITESPACE, fields, 2);
+    if(nbFields == 0)
+      continue;
+    if(nbFields < 2){
+      cerr << "ERROR: line " << reader.lineId() << " of file " << groupsFile
+           << " should have a name and a group" << endl;
+      exit(1);
+    }
+    size_t n = names.names.insert(line + fields[0].off, fields[0].len, isNew),
+      g = groups.insert(line + fields[1].off, fields[1].len, isNew);
+    pairs.push_back(make_pair(n, g));
+  }
+  reader.close();
+  
+  sort(pairs.begin(), pairs.end());
+  pairs.erase(unique(pairs.begin(), pairs.end()), pairs.end());
+  names.firsts.assign(names.names.size() + 1, 0);
+  for(size_t i = 0; i < pairs.size(); ++i){
+    ++names.firsts[pairs[i].first + 1];
+    names.ids.push_back(pairs[i].second);
+  }
+  for(size_t i = 0; i < names.names.size(); ++i)
+    names.firsts[i + 1] += names.firsts[i];
+  for(size_t g = 0; g < groups.size(); ++g){
+    const char * group = groups.key(g, len);
+    names.groups.push_back(string(group, len));
   }
-  closeFile(namesFile, stream);
   
   if (verbose > 0)
-    cout << "nb of names: " << names.size() << endl;
+    cout << "nb of names: " << names.names.size() << endl
+         << "nb of groups: " << names.groups.size() << endl;
 }
 
+static const size_t OUT_BUFFER_SIZE = 1 << 16; // one per group
+
+/** \brief One compressed output per group, or a single one, all sharing
+ *  the threads of a pool.
+ */
+class BedOutputs
+{
+public:
+  BedOutputs(
+    const vector<string> & outFiles,
+    const size_t & nbThreads,
+    ThreadPool * pool)
+  {
+    for(size_t i = 0; i < outFiles.size(); ++i){
+      writers_.push_back(new BgzfWriter(outFiles[i], nbThreads,
+                                        Z_DEFAULT_COMPRESSION, pool));
+      outs_.push_back(new BufferedWriter);
+      outs_.back()->open(writers_.back(), OUT_BUFFER_SIZE);
+    }
+  }
+  ~BedOutputs()
+  {
+    close();
+  }
+  BufferedWriter & operator[](const size_t & i) { return *outs_[i]; }
+  size_t size() const { return outs_.size(); }
+  void close()
+  {
+    for(size_t i = 0; i < outs_.size(); ++i){
+      outs_[i]->close();
+      writers_[i]->close();
+      delete outs_[i];
+      delete writers_[i];
+    }
+    outs_.clear();
+    writers_.clear();
+  }
+  
+private:
+  BedOutputs(const BedOutputs &);
+  BedOutputs & operator=(const BedOutputs &);
+  
+  vector<BgzfWriter *> writers_;
+  vector<BufferedWriter *> outs_;
+};
+
+/** \brief Whole lines of the input, filtered by one task.
+ */
+struct BedChunk
+{
+  const char * data; // into the mapped input, or into buf
+  size_t len;
+  string buf;
+  vector<string> matches; // one per output
+  bool done;
+};
+
+static const size_t CHUNK_SIZE = 1 << 20;
+
+/** \brief Keep the records of a chunk whose name is one of the names, for
+ *  each of the outputs of the name.
+ */
+static void filterChunk(
+  BedChunk & chunk,
+  const NameGroups & names,
+  const size_t & nbOutputs)
+{
+  chunk.matches.resize(nbOutputs);
+  for(size_t o = 0; o < nbOutputs; ++o)
+    chunk.matches[o].clear();
+  Field name;
+  const char * line = chunk.data, * end = chunk.data + chunk.len;
+  while(line < end){
+    const char * nl = (const char *) memchr(line, '\n', end - line);
+    size_t len = (nl == NULL ? end : nl) - line, n;
+    // only the name is located, and a record is copied as it is
+    if(findToken(line, len, DELIMS_WHITESPACE, 3, name)
+       && (n = names.find(line + name.off, name.len))
+       != StringIndex::npos){
+      for(size_t i = names.firsts[n]; i < names.firsts[n+1]; ++i){
+        string & matches = chunk.matches[names.ids[i]];
+        matches.append(line, len);
+        matches += '\n';
+      }
+    }
+    line += len + 1;
+  }
+}
+
+/** \brief Write the records whose name is one of the names, to the
+ *  outputs of the name.
+ *  \note One thread cuts the input in chunks of whole lines, as byte
+ *  ranges of the mapping for a plain file and as copies of the lines read
+ *  otherwise, the pool filters the chunks, and this thread writes them in
+ *  the order of the input. Whatever the number of outputs, the input is
+ *  read once and each record looked up once.
+ */
 void extractBedRecords(
-  const vector<string> & names,
+  const NameGroups & names,
   const string & inBedFile,
-  const string & outBedFile,
+  const vector<string> & outFiles,
+  const size_t & nbThreads,
   const int & verbose)
 {
   if(verbose > 0)
     cout << "extract records from file " << inBedFile << " ..." << endl;
   
-  gzFile inStream, outStream;
-  vector<string> tokens;
-  string line;
-  stringstream txt;
-  size_t nb_lines_out = 0;
-  openFile(inBedFile, inStream, "rb");
-  openFile(outBedFile, outStream, "wb");
-  while(getline(inStream, line)){
-    split(line, " \t", tokens);
-    if(find(names.begin(), names.end(), tokens[3]) != names.end()){
-      txt.str("");
-      txt << tokens[0];
-      for(size_t i = 1; i < tokens.size(); ++i)
-	txt << "\t" << tokens[i];
-      txt << endl;
-      ++nb_lines_out;
-      gzwriteLine(outStream, txt.str(), outBedFile, nb_lines_out);
+  ThreadPool pool(nbThreads); // filters, then compresses
+  MappedFile map;
+  LineReader reader;
+  if(isMappable(inBedFile))
+    map.open(inBedFile);
+  else
+    reader.open(inBedFile, LineReader::DEFAULT_BLOCK_SIZE, nbThreads);
+  BedOutputs outs(outFiles, nbThreads, &pool);
+  
+  const size_t maxChunks = 2 * nbThreads + 2;
+  deque<BedChunk *> chunks, freeChunks;
+  bool inputEnd = false;
+  mutex mtx;
+  condition_variable cond;
+  
+  thread cutter([&] () {
+      size_t pos = 0;
+      bool isLast = false;
+      while(! isLast){
+	BedChunk * chunk;
+	{
+	  unique_lock<mutex> lock(mtx);
+	  while(chunks.size() >= maxChunks)
+	    cond.wait(lock);
+	  if(freeChunks.empty())
+	    chunk = new BedChunk;
+	  else{
+	    chunk = freeChunks.back();
+	    freeChunks.pop_back();
+	  }
+	}
+	chunk->done = false;
+	if(map.isOpen()){
+	  size_t end = min(pos + CHUNK_SIZE, map.size());
+	  const char * nl = (end == map.size()) ? NULL :
+	    (const char *) memchr(map.data() + end, '\n', map.size() - end);
+	  end = (nl == NULL ? map.size() : nl - map.data() + 1);
+	  chunk->data = map.data() + pos;
+	  chunk->len = end - pos;
+	  pos = end;
+	  isLast = (pos == map.size());
+	}
+	else{
+	  const char * line;
+	  size_t len;
+	  chunk->buf.clear();
+	  while(chunk->buf.size() < CHUNK_SIZE && ! isLast){
+	    if(reader.getline(line, len)){
+	      chunk->buf.append(line, len);
+	      chunk->buf += '\n';
+	    }
+	    else
+	      isLast = true;
+	  }
+	  chunk->data = chunk->buf.data();
+	  chunk->len = chunk->buf.size();
+	}
+	{
+	  lock_guard<mutex> lock(mtx);
+	  chunks.push_back(chunk);
+	  inputEnd = isLast;
+	}
+	cond.notify_all();
+	pool.submit([&, chunk] () {
+	    filterChunk(*chunk, names, outs.size());
+	    lock_guard<mutex> lock(mtx); // cond may go as soon as it is done
+	    chunk->done = true;
+	    cond.notify_all();
+	  });
+      }
+    });
+  
+  while(true){
+    BedChunk * chunk;
+    {
+      unique_lock<mutex> lock(mtx);
+      while(! (! chunks.empty() && chunks.front()->done)
+	    && ! (chunks.empty() && inputEnd))
+	cond.wait(lock);
+      if(chunks.empty())
+	break;
+      chunk = chunks.front();
+    }
+    for(size_t o = 0; o < outs.size(); ++o)
+      outs[o].write(chunk->matches[o]);
+    {
+      lock_guard<mutex> lock(mtx);
+      chunks.pop_front();
+      freeChunks.push_back(chunk);
     }
+    cond.notify_all();
   }
-  if(! gzeof(inStream)){
-    cerr << "ERROR: can't read successfully file "
-	 << inBedFile << " up to the end" << endl;
-    exit(1);
+  cutter.join();
+  for(size_t i = 0; i < freeChunks.size(); ++i)
+    delete freeChunks[i];
+  
+  if(map.isOpen())
+    map.close();
+  else
+    reader.close();
+  outs.close();
+}
+
+/** \brief A region of a sequence of the index, zero-based and end excluded.
+ */
+struct Region
+{
+  size_t seqId;
+  uint64_t beg, end;
+  bool operator<(const Region & other) const
+  {
+    return seqId < other.seqId
+      || (seqId == other.seqId && beg < other.beg);
+  }
+};
+
+/** \brief Load the regions on the sequences of the index, sorted as the
+ *  records and with the overlapping ones merged.
+ *  \note Header lines ("#", "track" and "browser") are skipped.
+ */
+void loadRegions(
+  const string & regionsFile,
+  const TabixIndex & index,
+  const int & verbose,
+  vector<Region> & regions)
+{
+  if(verbose > 0)
+    cout << "load regions from file " << regionsFile << " ..." << endl;
+  
+  LineReader reader(regionsFile);
+  Field fields[3];
+  const char * line;
+  size_t len, beg, end, nbLines = 0, nbUnknown = 0;
+  while(reader.getline(line, len)){
+    ++nbLines;
+    if(len == 0 || line[0] == '#' || strncmp(line, "track", 5) == 0
+       || strncmp(line, "browser", 7) == 0)
+      continue;
+    if(tokenize(line, len, DELIMS_WHITESPACE, fields, 3) < 3
+       || ! parseSize(line + fields[1].off, fields[1].len, beg)
+       || ! parseSize(line + fields[2].off, fields[2].len, end)){
+      cerr << "ERROR: line " << nbLines << " of file " << regionsFile
+           << " should have a sequence, a start and an end" << endl;
+      exit(1);
+    }
+    Region region;
+    region.seqId = index.findSeq(line + fields[0].off, fields[0].len);
+    region.beg = beg;
+    region.end = end;
+    if(region.seqId == StringIndex::npos)
+      ++nbUnknown;
+    else if(beg < end)
+      regions.push_back(region);
+  }
+  reader.close();
+  
+  sort(regions.begin(), regions.end());
+  size_t nbMerged = 0;
+  for(size_t i = 0; i < regions.size(); ++i){
+    if(nbMerged > 0 && regions[nbMerged-1].seqId == regions[i].seqId
+       && regions[nbMerged-1].end >= regions[i].beg)
+      regions[nbMerged-1].end = max(regions[nbMerged-1].end, regions[i].end);
+    else
+      regions[nbMerged++] = regions[i];
+  }
+  regions.resize(nbMerged);
+  
+  if(verbose > 0){
+    cout << "nb of regions (once merged): " << regions.size() << endl;
+    if(nbUnknown > 0)
+      cout << "nb of regions on sequences without records: " << nbUnknown
+           << endl;
+  }
+}
+
+/** \brief Write the records overlapping the regions and, if there are
+ *  names, whose name is one of them, to the outputs of the name.
+ *  \note For each region, only the blocks of the chunks of records which
+ *  may overlap it are inflated.
+ */
+void extractBedRegions(
+  const NameGroups * names,
+  const TabixIndex & index,
+  const vector<Region> & regions,
+  const string & inBedFile,
+  const vector<string> & outFiles,
+  const size_t & nbThreads,
+  const int & verbose)
+{
+  if(verbose > 0)
+    cout << "extract records from file " << inBedFile << " ..." << endl;
+  
+  RegionReader reader(inBedFile, index);
+  ThreadPool pool(nbThreads);
+  BedOutputs outs(outFiles, nbThreads, &pool);
+  
+  Field name;
+  const char * line;
+  size_t len, n, nbRecords = 0;
+  uint64_t beg, end;
+  for(size_t i = 0; i < regions.size(); ++i){
+    const Region & region = regions[i];
+    if(! reader.seek(region.seqId, region.beg, region.end))
+      continue;
+    // records overlapping the previous region too were already written
+    uint64_t prevEnd = (i > 0 && regions[i-1].seqId == region.seqId) ?
+      regions[i-1].end : 0;
+    while(reader.getline(line, len, beg, end)){
+      if(beg < prevEnd)
+        continue;
+      if(names == NULL)
+        outs[0].writeLine(line, len);
+      else if(findToken(line, len, DELIMS_WHITESPACE, 3, name)
+              && (n = names->find(line + name.off, name.len))
+              != StringIndex::npos){
+        for(size_t k = names->firsts[n]; k < names->firsts[n+1]; ++k)
+          outs[names->ids[k]].writeLine(line, len);
+      }
+      else
+        continue;
+      ++nbRecords;
+    }
   }
-  closeFile(inBedFile, inStream);
-  closeFile(outBedFile, outStream);
+  
+  reader.close();
+  outs.close();
+  
+  if(verbose > 0)
+    cout << "nb of records: " << nbRecords << endl;
 }
 
 void run(
   const string & namesFile,
+  const string & groupsFile,
+  const string & regionsFile,
   const string & inBedFile,
   const string & outBedFile,
+  const bool & isCompact,
+  const size_t & bloomBits,
+  const size_t & nbThreads,
   const int & verbose)
 {
-  vector<string> names;
-  loadNames(namesFile, verbose, names);
+  NameGroups names;
+  if(! namesFile.empty())
+    loadNames(namesFile, isCompact, bloomBits, verbose, names);
+  else if(! groupsFile.empty())
+    loadGroups(groupsFile, verbose, names);
+  vector<string> outFiles;
+  for(size_t g = 0; g < names.groups.size(); ++g)
+    outFiles.push_back(outBedFile + names.groups[g] + ".bed.gz");
+  if(groupsFile.empty())
+    outFiles.push_back(outBedFile);
+  
+  if(regionsFile.empty()){
+    extractBedRecords(names, inBedFile, outFiles, nbThreads, verbose);
+    return;
+  }
+  
+  if(verbose > 0)
+    cout << "load or build index " << TabixIndex::getPath(inBedFile)
+         << " ..." << endl;
+  TabixIndex index;
+  index.open(inBedFile, TABIX_BED);
+  vector<Region> regions;
+  loadRegions(regionsFile, index, verbose, regions);
   
-  extractBedRecords(names, inBedFile, outBedFile, verbose);
+  bool hasNames = ! (namesFile.empty() && groupsFile.empty());
+  extractBedRegions(hasNames ? &names : NULL, index, regions, inBedFile,
+                    outFiles, nbThreads, verbose);
 }
 
 int main(int argc, char ** argv)
 {
-  string namesFile, inBedFile, outBedFile;
+  string namesFile, groupsFile, regionsFile, inBedFile, outBedFile;
+  bool isCompact = false;
+  size_t bloomBits = 0, nbThreads = 1;
   int verbose = 1;
   
-  parseCmdLine(argc, argv, namesFile, inBedFile, outBedFile, verbose);
+  parseCmdLine(argc, argv, namesFile, groupsFile, regionsFile, inBedFile,
+               outBedFile, isCompact, bloomBits, nbThreads, verbose);
   
   time_t startRawTime, endRawTime;
   if (verbose > 0)
@@ -267,7 +811,8 @@ int main(int argc, char ** argv)
     cout << flush;
   }
   
-  run(namesFile, inBedFile, outBedFile, verbose);
+  run(namesFile, groupsFile, regionsFile, inBedFile, outBedFile, isCompact,
+      bloomBits, nbThreads, verbose);
   
   if (verbose > 0)
   {
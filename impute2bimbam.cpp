@@ -16,7 +16,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
- *  gcc -Wall impute2bimbam.cpp -lstdc++ -o impute2bimbam
+ *  g++ -Wall -std=c++11 -pthread impute2bimbam.cpp utils_io.cpp -lgsl -lgslcblas -lz -o impute2bimbam
  *  help2man -o impute2bimbam.man ./impute2bimbam
  *  groff -mandoc impute2bimbam.man > impute2bimbam.ps
 */
@@ -24,13 +24,21 @@
 #include <cmath>
 #include <ctime>
 #include <getopt.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <iterator>
 #include <vector>
+#include <deque>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 using namespace std;
 
 #include "utils.cpp"
@@ -49,21 +57,94 @@ void help (char ** argv)
        << "  -V, --version\toutput version information and exit" << endl
        << "  -v, --verbose\tverbosity level (default=1)" << endl
        << "  -i, --input\tfile with genotypes in the IMPUTE format" << endl
-       << "\t\teg. '~/data/genotypes.impute'" << endl
+       << "\t\teg. '~/data/genotypes.impute', possibly gzipped" << endl
+       << "  -g, --glob\tpattern of files to convert instead of --input" << endl
+       << "\t\teg. '~/data/genotypes_chr*.impute.gz', quoted for the shell"
+       << endl
+       << "\t\tthe largest files start first, and all share the threads"
+       << endl
        << "  -o, --output\tgeneric prefix for the output files" << endl
        << "\t\tgives <prefix>.bimbam and <prefix>_snpAnnot.txt" << endl
+       << "\t\twith --glob, optional and added before the name of each file"
+       << endl
+       << "\t\twithout '.gz' and '.impute', eg. 'out/'" << endl
+       << "  -r, --region\tconvert only the SNPs of a region, eg. '1:1000-2000'"
+       << endl
+       << "\t\tthe sequence being as in the first column, and positions"
+       << endl
+       << "\t\tfrom 1, the input should then be sorted and in the BGZF"
+       << endl
+       << "\t\tformat, its index (<input>.tbi) being built if necessary"
+       << endl
        << "  -d, --discard\tfile with a list of individuals to discard" << endl
        << "\t\tone number per line, for the index of the column to skip" << endl
-       << "  -H, --head\tindicate if input file has a header line\n" << endl
+       << "  -k, --keep\tfile with a list of individuals to keep" << endl
+       << "\t\tone name per line, as in the header (needs -H)" << endl
+       << "  -x, --exclude\tfile with a list of individuals to discard" << endl
+       << "\t\tone name per line, those absent from the header being ignored"
+       << endl
+       << "\t\t(needs -H)" << endl
+       << "  -H, --head\tindicate if input file has a header line" << endl
+       << "\t\twith one name per individual or per probability column"
+       << endl
+       << "  -b, --binary\twrite dosages in binary, as 'float32' or 'uint8'"
+       << endl
+       << "\t\tgives <prefix>.dosage instead of <prefix>.bimbam, and the alleles"
+       << endl
+       << "\t\tare added to <prefix>_snpAnnot.txt (see the remarks)" << endl
+       << "  -p, --precision\tnumber of significant digits of the dosages"
+       << endl
+       << "\t\tin text (default=6), or 0 for the fewest reading back the"
+       << endl
+       << "\t\tsame number, up to 17" << endl
+       << "  -I, --min-info\tminimum info score of the SNPs to convert"
+       << endl
+       << "\t\tas computed by IMPUTE, between 0 (default) and 1" << endl
+       << "  -F, --min-maf\tminimum minor allele frequency of the SNPs"
+       << endl
+       << "\t\tto convert, between 0 (default) and 0.5" << endl
+       << "\t\tindividuals whose probabilities are all 0 are ignored" << endl
+       << "  -T, --transpose\talso write the dosages with one row per"
+       << endl
+       << "\t\tindividual, in <prefix>_transposed.bimbam" << endl
+       << "\t\tthe rows 1 to 3 having the SNP ids and alleles" << endl
+       << "  -m, --memory\tmemory used to transpose, in MB (default=1024)"
+       << endl
+       << "\t\tshared by the files converted at once, larger files being"
+       << endl
+       << "\t\ttransposed by pieces in temporary files next to the output"
+       << endl
+       << "  -z, --gzip\tcompress the output files in BGZF, adding '.gz'"
+       << endl
+       << "\t\tthe threads converting lines also compress them" << endl
+       << "  -t, --threads\tnumber of threads converting lines (default=1)"
+       << endl
+       << "\t\tone more thread reads the input\n" << endl
        << endl
        << "Examples:" << endl
        << "$ " << argv[0] << " -i ~/data/genotypes.impute -o genotypes" << endl
-       << "$ ls genotypes_chr*.impute | while read f; do \\" << endl
-       << argv[0] << " -i ${f} -o $(basename ${f} .impute); done" << endl
+       << "$ " << argv[0] << " -g 'genotypes_chr*.impute' -t 8" << endl
        << endl
        << "Remarks:" << endl
        << "Allele A in the IMPUTE format is considerd to be the minor allele for BIMBAM."
-       << endl;
+       << endl
+       << "The binary dosage file starts with a header of 64 bytes, then has one"
+       << endl
+       << "row per SNP, the dosage of SNP i being at offset 64 + i * row size."
+       << endl
+       << "All numbers are little-endian. The header has: 'IMPDOSE' and version 1"
+       << endl
+       << "(8 bytes), the type (uint32, 1 for float32 and 2 for uint8), 4 bytes of"
+       << endl
+       << "padding, the number of SNPs, of individuals and the row size (uint64 each,"
+       << endl
+       << "at offsets 16, 24 and 32), then the scale (float32, at offset 40), the"
+       << endl
+       << "dosage being the value times the scale. Missing dosages, ie. when all"
+       << endl
+       << "three probabilities are 0, are NaN in float32 and 255 in uint8, where"
+       << endl
+       << "dosages are otherwise rounded to multiples of 1/127." << endl;
 }
 
 void version (char ** argv)
@@ -78,6 +159,14 @@ void version (char ** argv)
        << "Written by T. Flutre." << endl;
 }
 
+/** \brief Thresholds below which a SNP isn't converted.
+ */
+struct SnpFilter
+{
+  double minInfo;
+  double minMaf;
+};
+
 /** \brief Parse the command-line arguments and check the values of the 
  *  compulsory ones.
  */
@@ -85,9 +174,20 @@ void parse_args (
   int argc,
   char ** argv,
   string & inFile,
+  string & pattern,
   string & output,
+  string & region,
   string & indsFile,
+  string & keepFile,
+  string & excludeFile,
   bool & hasHeader,
+  size_t & nbThreads,
+  string & binaryType,
+  int & precision,
+  SnpFilter & filter,
+  bool & isTransposed,
+  size_t & memory,
+  bool & isGzipped,
   int & verbose)
 {
   int c = 0;
@@ -99,13 +199,25 @@ void parse_args (
 	{"version", no_argument, 0, 'V'},
 	{"verbose", required_argument, 0, 'v'},
 	{"input", required_argument, 0, 'i'},
+	{"glob", required_argument, 0, 'g'},
 	{"output", required_argument, 0, 'o'},
+	{"region", required_argument, 0, 'r'},
 	{"discard", required_argument, 0, 'd'},
+	{"keep", required_argument, 0, 'k'},
+	{"exclude", required_argument, 0, 'x'},
 	{"head", no_argument, 0, 'H'},
+	{"threads", required_argument, 0, 't'},
+	{"binary", required_argument, 0, 'b'},
+	{"precision", required_argument, 0, 'p'},
+	{"min-info", required_argument, 0, 'I'},
+	{"min-maf", required_argument, 0, 'F'},
+	{"transpose", no_argument, 0, 'T'},
+	{"memory", required_argument, 0, 'm'},
+	{"gzip", no_argument, 0, 'z'},
 	{0, 0, 0, 0}
       };
     int option_index = 0;
-    c = getopt_long (argc, argv, "hVv:i:o:d:H",
+    c = getopt_long (argc, argv, "hVv:i:g:o:r:d:k:x:Ht:b:p:I:F:Tm:z",
 		     long_options, &option_index);
     if (c == -1)
       break;
@@ -131,129 +243,882 @@ void parse_args (
     case 'i':
       inFile = optarg;
       break;
+    case 'g':
+      pattern = optarg;
+      break;
     case 'o':
       output = optarg;
       break;
+    case 'r':
+      region = optarg;
+      break;
     case 'd':
       indsFile = optarg;
       break;
+    case 'k':
+      keepFile = optarg;
+      break;
+    case 'x':
+      excludeFile = optarg;
+      break;
     case 'H':
       hasHeader = true;
       break;
+    case 't':
+      nbThreads = atol(optarg);
+      break;
+    case 'b':
+      binaryType = optarg;
+      break;
+    case 'p':
+      precision = atoi(optarg);
+      break;
+    case 'I':
+      filter.minInfo = atof(optarg);
+      break;
+    case 'F':
+      filter.minMaf = atof(optarg);
+      break;
+    case 'T':
+      isTransposed = true;
+      break;
+    case 'm':
+      memory = atol(optarg);
+      break;
+    case 'z':
+      isGzipped = true;
+      break;
     case '?':
       break;
     default:
       abort ();
     }
   }
-  if (inFile.empty())
+  if (inFile.empty() == pattern.empty())
   {
-    fprintf (stderr, "ERROR: missing input (-i).\n\n");
+    fprintf (stderr, "ERROR: missing input (-i), or pattern (-g).\n\n");
     help (argv);
     exit (1);
   }
-  if (output.empty())
+  if (output.empty() && pattern.empty())
   {
     fprintf (stderr, "ERROR: missing output (-o).\n\n");
     help (argv);
     exit (1);
   }
+  string seq;
+  uint64_t beg, end;
+  if (! region.empty() && ! utils::parseRegion (region, seq, beg, end))
+  {
+    fprintf (stderr, "ERROR: --region should be as 'seq', 'seq:beg' or"
+	     " 'seq:beg-end'.\n\n");
+    help (argv);
+    exit (1);
+  }
+  if (nbThreads == 0)
+  {
+    fprintf (stderr, "ERROR: --threads should be at least 1\n\n");
+    help (argv);
+    exit (1);
+  }
+  if (! binaryType.empty() && binaryType != "float32" && binaryType != "uint8")
+  {
+    fprintf (stderr, "ERROR: --binary should be 'float32' or 'uint8'.\n\n");
+    help (argv);
+    exit (1);
+  }
+  if (precision < 0 || precision > 17)
+  {
+    fprintf (stderr, "ERROR: --precision should be between 0 and 17.\n\n");
+    help (argv);
+    exit (1);
+  }
+  if (! (filter.minInfo >= 0 && filter.minInfo <= 1))
+  {
+    fprintf (stderr, "ERROR: --min-info should be between 0 and 1.\n\n");
+    help (argv);
+    exit (1);
+  }
+  if (! (filter.minMaf >= 0 && filter.minMaf <= 0.5))
+  {
+    fprintf (stderr, "ERROR: --min-maf should be between 0 and 0.5.\n\n");
+    help (argv);
+    exit (1);
+  }
+  if (isTransposed && ! binaryType.empty())
+  {
+    fprintf (stderr, "ERROR: --transpose needs dosages in text.\n\n");
+    help (argv);
+    exit (1);
+  }
+  if (memory == 0)
+  {
+    fprintf (stderr, "ERROR: --memory should be at least 1\n\n");
+    help (argv);
+    exit (1);
+  }
+  if (! binaryType.empty() && isGzipped)
+  {
+    fprintf (stderr, "ERROR: --binary output is meant to be mapped in memory,"
+	     " so it can't be gzipped.\n\n");
+    help (argv);
+    exit (1);
+  }
+  if ((! keepFile.empty() || ! excludeFile.empty()) && ! hasHeader)
+  {
+    fprintf (stderr, "ERROR: --keep and --exclude need a header (-H).\n\n");
+    help (argv);
+    exit (1);
+  }
+}
+
+/** \brief Individuals to convert, given by the index of their columns
+ *  and/or by their names in the header.
+ */
+struct SampleSelection
+{
+  utils::SizeIndex idxToSkip;
+  utils::StringIndex namesToKeep;
+  utils::StringSet namesToSkip;
+};
+
+/** \brief Tokenize a line of an IMPUTE file, whose columns are separated
+ *  by tabs or else by spaces.
+ */
+static inline void
+tokenizeImputeLine (
+  const string & line,
+  vector<utils::Field> & tokens)
+{
+  if (line.find('\t') != string::npos)
+    utils::tokenize (line, utils::DELIMS_TAB, tokens, true);
+  else
+    utils::tokenize (line, utils::DELIMS_SPACE, tokens, true);
+}
+
+/** \brief Resolve the selection once, into the sorted list of the indices
+ *  of the individuals to convert.
+ *  \note The header has either one name per individual or one name per
+ *  probability column, after the 5 columns describing the SNP.
+ */
+static void
+getSamplesToKeep (
+  const SampleSelection & selection,
+  const string & header,
+  const size_t & nbSamples,
+  const string & inFile,
+  vector<size_t> & vIdxIndsToKeep)
+{
+  bool hasNames = (selection.namesToKeep.size() > 0
+		   || selection.namesToSkip.size() > 0);
+  vector<utils::Field> tokens;
+  size_t step = 0;
+  if (hasNames)
+  {
+    tokenizeImputeLine (header, tokens);
+    if (tokens.size() == 5 + nbSamples)
+      step = 1;
+    else if (tokens.size() == 5 + 3 * nbSamples)
+      step = 3;
+    else
+    {
+      cerr << "ERROR: the header of file " << inFile << " should have "
+	   << 5 + nbSamples << " or " << 5 + 3 * nbSamples << " columns"
+	   << " for " << nbSamples << " individuals" << endl;
+      exit (1);
+    }
+  }
+  
+  vector<bool> vIsKept (nbSamples, selection.namesToKeep.size() == 0);
+  vector<bool> vIsFound (selection.namesToKeep.size(), false);
+  for (size_t i = 0; hasNames && i < nbSamples; ++i)
+  {
+    const utils::Field & name = tokens[5 + step * i];
+    const char * ptName = header.data() + name.off;
+    size_t k = selection.namesToKeep.find (ptName, name.len);
+    if (k != utils::StringIndex::npos)
+      vIsKept[i] = vIsFound[k] = true;
+    if (selection.namesToSkip.contains (ptName, name.len))
+      vIsKept[i] = false;
+  }
+  for (size_t k = 0; k < vIsFound.size(); ++k)
+    if (! vIsFound[k])
+    {
+      cerr << "ERROR: individual " << selection.namesToKeep.str(k)
+	   << " to keep isn't in the header of file " << inFile << endl;
+      exit (1);
+    }
+  
+  vIdxIndsToKeep.clear();
+  for (size_t i = 0; i < nbSamples; ++i)
+    if (vIsKept[i] && ! selection.idxToSkip.contains (i))
+      vIdxIndsToKeep.push_back (i);
 }
 
+/** \brief Lines of the input converted together by one thread, the
+ *  batches being written in the order in which they were read.
+ */
+struct ConvertBatch
+{
+  size_t firstLineId;
+  size_t nbLines;
+  vector<string> lines; // only the first nbLines are filled
+  size_t nbSnps; // converted lines, the others being filtered out
+  string dosages, snpAnnot; // converted lines, dosages in text or binary
+  vector<double> probas; // of the kept individuals, one genotype after the other
+  vector<double> vDosages;
+  string error;
+  bool done;
+};
+
+static const size_t LINES_PER_BATCH = 256;
+
+/** \brief Format of the dosages, as text for BIMBAM or as binary rows.
+ */
+enum DosageType
+{
+  DOSAGE_TEXT = 0,
+  DOSAGE_FLOAT32 = 1,
+  DOSAGE_UINT8 = 2
+};
+
+static const size_t DOSAGE_HEADER_SIZE = 64;
+
+static const float DOSAGE_UINT8_SCALE = 1.0f / 127;
+
+static inline void
+appendLittleEndian (
+  string & out,
+  const uint64_t & v,
+  const size_t & n)
+{
+  for (size_t i = 0; i < n; ++i)
+    out += (char) (v >> (8 * i));
+}
+
+/** \brief Append a dosage to a binary row.
+ *  \note NaN, which marks a missing dosage, fails every comparison.
+ */
+static inline void
+appendBinaryDosage (
+  string & out,
+  const DosageType & type,
+  const double & dosage)
+{
+  if (type == DOSAGE_FLOAT32)
+  {
+    float f = (float) dosage;
+    uint32_t bits;
+    memcpy (&bits, &f, 4);
+    appendLittleEndian (out, bits, 4);
+  }
+  else if (dosage >= 0 && dosage <= 2)
+    out += (char) (unsigned char) floor (dosage / DOSAGE_UINT8_SCALE + 0.5);
+  else
+    out += (char) 255;
+}
+
+/** \brief Write the header of a binary dosage file, which is rewritten
+ *  once all SNPs are known.
+ */
+static void
+writeDosageHeader (
+  utils::BufferedWriter & out,
+  const DosageType & type,
+  const uint64_t & nbSnps,
+  const uint64_t & nbSamples,
+  const bool & isRewritten)
+{
+  string header ("IMPDOSE\1", 8);
+  appendLittleEndian (header, type, 4);
+  header.resize (16, '\0'); // so that the uint64 fields are 8-byte aligned
+  appendLittleEndian (header, nbSnps, 8);
+  appendLittleEndian (header, nbSamples, 8);
+  appendLittleEndian (header, nbSamples * (type == DOSAGE_FLOAT32 ? 4 : 1), 8);
+  float scale = (type == DOSAGE_FLOAT32 ? 1.0f : DOSAGE_UINT8_SCALE);
+  uint32_t bits;
+  memcpy (&bits, &scale, 4);
+  appendLittleEndian (header, bits, 4);
+  header.resize (DOSAGE_HEADER_SIZE, '\0');
+  if (isRewritten)
+    out.rewrite (0, header.data(), header.size());
+  else
+    out.write (header);
+}
+
+/** \brief Summary of the genotype probabilities of a SNP, over the
+ *  individuals whose probabilities aren't all 0.
+ */
+struct SnpStats
+{
+  double freqA;     // frequency of allele A
+  double info;      // as the info score of IMPUTE
+  double certainty; // mean probability of the most likely genotype
+  size_t nbCalled;
+};
+
+/** \brief Compute the dosages of allele A, 2 * P(AA) + P(AB), and in the
+ *  same pass the statistics of the SNP.
+ *  \note With e and f the expectations of the dosage and of its square,
+ *  and theta the frequency of allele A, the info score is
+ *  1 - sum(f - e^2) / (2N theta (1 - theta)), or 1 if theta is 0 or 1.
+ *  It doesn't depend on the allele counted.
+ *  Two individuals at a time are processed when SSE2 is available.
+ */
+static void
+computeDosages (
+  const double * pAA,
+  const double * pAB,
+  const double * pBB,
+  const size_t & n,
+  double * dosages,
+  SnpStats & stats)
+{
+  double sumE = 0, sumVar = 0, sumMax = 0, nbCalled = 0;
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128d zero = _mm_setzero_pd(), one = _mm_set1_pd (1);
+  __m128d vSumE = zero, vSumVar = zero, vSumMax = zero, vNbCalled = zero;
+  for (; i + 2 <= n; i += 2)
+  {
+    __m128d aa = _mm_loadu_pd (pAA + i), ab = _mm_loadu_pd (pAB + i),
+      bb = _mm_loadu_pd (pBB + i);
+    // 0 * P(BB) is kept, as it gives 0 rather than -0 for signed zeros
+    __m128d e = _mm_add_pd (_mm_add_pd (_mm_add_pd (aa, aa), ab),
+			    _mm_mul_pd (zero, bb));
+    _mm_storeu_pd (dosages + i, e);
+    __m128d called = _mm_cmpneq_pd (_mm_add_pd (_mm_add_pd (aa, ab), bb),
+				    zero);
+    __m128d f = _mm_add_pd (_mm_mul_pd (_mm_set1_pd (4), aa), ab);
+    __m128d var = _mm_sub_pd (f, _mm_mul_pd (e, e));
+    __m128d best = _mm_max_pd (_mm_max_pd (aa, ab), bb);
+    vSumE = _mm_add_pd (vSumE, _mm_and_pd (called, e));
+    vSumVar = _mm_add_pd (vSumVar, _mm_and_pd (called, var));
+    vSumMax = _mm_add_pd (vSumMax, _mm_and_pd (called, best));
+    vNbCalled = _mm_add_pd (vNbCalled, _mm_and_pd (called, one));
+  }
+  double lanes[2];
+  _mm_storeu_pd (lanes, vSumE);
+  sumE = lanes[0] + lanes[1];
+  _mm_storeu_pd (lanes, vSumVar);
+  sumVar = lanes[0] + lanes[1];
+  _mm_storeu_pd (lanes, vSumMax);
+  sumMax = lanes[0] + lanes[1];
+  _mm_storeu_pd (lanes, vNbCalled);
+  nbCalled = lanes[0] + lanes[1];
+#endif
+  for (; i < n; ++i)
+  {
+    double e = 2 * pAA[i] + pAB[i] + 0 * pBB[i];
+    dosages[i] = e;
+    if (pAA[i] + pAB[i] + pBB[i] != 0)
+    {
+      sumE += e;
+      sumVar += 4 * pAA[i] + pAB[i] - e * e;
+      sumMax += max (max (pAA[i], pAB[i]), pBB[i]);
+      ++nbCalled;
+    }
+  }
+  
+  stats.nbCalled = (size_t) nbCalled;
+  if (nbCalled == 0)
+  {
+    stats.freqA = NAN;
+    stats.info = stats.certainty = 0;
+    return;
+  }
+  stats.freqA = sumE / (2 * nbCalled);
+  stats.certainty = sumMax / nbCalled;
+  if (stats.freqA <= 0 || stats.freqA >= 1)
+    stats.info = 1;
+  else
+    stats.info = 1 - sumVar / (2 * nbCalled * stats.freqA
+			       * (1 - stats.freqA));
+}
+
+/** \brief Return true if the SNP passes the thresholds, those at 0 being
+ *  always passed.
+ */
+static inline bool
+isSnpKept (
+  const SnpStats & stats,
+  const SnpFilter & filter)
+{
+  if (filter.minInfo > 0 && ! (stats.info >= filter.minInfo))
+    return false;
+  if (filter.minMaf > 0 && ! (min (stats.freqA, 1 - stats.freqA)
+			      >= filter.minMaf))
+    return false;
+  return true;
+}
+
+/** \brief Write a token of a line at the end of a string.
+ */
+static inline void
+appendField (
+  string & out,
+  const string & line,
+  const utils::Field & field)
+{
+  out.append (line, field.off, field.len);
+}
+
+/** \brief Write a number as "%.<precision>g" does, 6 being the default of
+ *  ostream's operator<<.
+ */
+static inline void
+appendDouble (
+  string & out,
+  const double & x,
+  const int & precision)
+{
+  char buf[utils::FORMAT_DOUBLE_SIZE];
+  out.append (buf, utils::formatDouble (buf, x, precision));
+}
+
+/** \brief Convert the lines of a batch into BIMBAM, in memory.
+ *  \note An error is kept in the batch, to be reported by the writer in
+ *  the order of the lines.
+ */
+static void
+convertBatch (
+  ConvertBatch & batch,
+  const vector<size_t> & vIdxIndsToKeep,
+  const size_t & nbSamples,
+  const DosageType & type,
+  const int & precision,
+  const SnpFilter & filter,
+  const string & inFile)
+{
+  vector<utils::Field> tokens;
+  const size_t n = vIdxIndsToKeep.size();
+  batch.nbSnps = 0;
+  batch.dosages.clear();
+  batch.snpAnnot.clear();
+  batch.error.clear();
+  batch.probas.resize (3 * n);
+  batch.vDosages.resize (n);
+  double * probas[3] = {batch.probas.data(), batch.probas.data() + n,
+			batch.probas.data() + 2 * n};
+  SnpStats stats;
+  
+  for (size_t l = 0; l < batch.nbLines; ++l)
+  {
+    const string & line = batch.lines[l];
+    size_t lineId = batch.firstLineId + l;
+    
+    tokenizeImputeLine (line, tokens);
+    if (tokens.size() < 5 || (tokens.size() - 5) / 3 != nbSamples)
+    {
+      stringstream ss;
+      ss << "ERROR: line " << lineId << " of file " << inFile
+	 << " should have " << 5 + 3 * nbSamples << " columns";
+      batch.error = ss.str();
+      return;
+    }
+    
+    for (size_t k = 0; k < n; ++k)
+    {
+      size_t i = vIdxIndsToKeep[k];
+      for (size_t j = 0; j < 3; ++j)
+      {
+	const utils::Field & field = tokens[5+3*i+j];
+	if (! utils::parseDouble (line.data() + field.off, field.len,
+				  probas[j][k]))
+	{
+	  batch.error = "ERROR: can't parse genotype probability '"
+	    + line.substr (field.off, field.len) + "' at line "
+	    + utils::toString (lineId) + " of file " + inFile;
+	  return;
+	}
+      }
+    }
+    computeDosages (probas[0], probas[1], probas[2], n, batch.vDosages.data(),
+		    stats);
+    if (! isSnpKept (stats, filter))
+      continue;
+    ++batch.nbSnps;
+    
+    if (type == DOSAGE_TEXT)
+    {
+      appendField (batch.dosages, line, tokens[1]);  // SNP id
+      batch.dosages += ' ';
+      appendField (batch.dosages, line, tokens[3]);  // allele A (minor allele for BimBam)
+      batch.dosages += ' ';
+      appendField (batch.dosages, line, tokens[4]);  // allele B (major allele for BimBam)
+      for (size_t k = 0; k < n; ++k)
+      {
+	batch.dosages += ' ';
+	appendDouble (batch.dosages, batch.vDosages[k], precision);
+      }
+      batch.dosages += '\n';
+    }
+    else
+      for (size_t k = 0; k < n; ++k)
+	if (probas[0][k] == 0 && probas[1][k] == 0 && probas[2][k] == 0)
+	  appendBinaryDosage (batch.dosages, type, NAN);
+	else
+	  appendBinaryDosage (batch.dosages, type, batch.vDosages[k]);
+    appendField (batch.snpAnnot, line, tokens[1]);  // SNP id
+    batch.snpAnnot += ' ';
+    appendField (batch.snpAnnot, line, tokens[2]);  // SNP coordinate
+    batch.snpAnnot += ' ';
+    appendField (batch.snpAnnot, line, tokens[0]);  // chromosome
+    if (type != DOSAGE_TEXT)
+    {
+      batch.snpAnnot += ' ';
+      appendField (batch.snpAnnot, line, tokens[3]);  // allele A
+      batch.snpAnnot += ' ';
+      appendField (batch.snpAnnot, line, tokens[4]);  // allele B
+    }
+    batch.snpAnnot += '\n';
+  }
+}
+
+/** \brief Convert a file in the IMPUTE format into BIMBAM.
+ *  \note One thread reads the input by batches of lines, the threads of
+ *  the pool convert the batches, and this thread writes them in the order
+ *  of the input, so that the output doesn't depend on the number of
+ *  threads.
+ */
 void convertImputeFileToBimbamFiles (
   const string inFile,
   const string output,
-  const vector<size_t> vIdxIndsToSkip,
+  const string region,
+  const SampleSelection & selection,
   const bool hasHeader,
+  const size_t nbInflateThreads,
+  const DosageType type,
+  const int precision,
+  const SnpFilter & filter,
+  const size_t transposeMemory,
+  const bool isGzipped,
+  utils::ThreadPool & pool,
   const int verbose)
 {
-  string line;
-  ifstream inStream;
-  vector<string> tokens;
-  ofstream outStream1, outStream2;
-  size_t nbSamples = 0;
+  utils::LineReader inReader;
+  utils::TabixIndex index;
+  utils::RegionReader regionReader;
+  utils::BgzfWriter outWriter1, outWriter2;
+  utils::BufferedWriter outStream1, outStream2;
   stringstream ss;
   
-  if (verbose > 0)
-  {
-    cout << "convert genotypes from file '" << inFile << "' ..." << endl;
-    fflush (stdout);
-  }
+  if (verbose > 0) // in one go, as files may be converted concurrently
+    cout << "convert genotypes from file '" + inFile + "' ...\n" << flush;
   
-  inStream.open (inFile.c_str());
-  if (! inStream.is_open())
+  if (region.empty())
+    inReader.open (inFile, utils::LineReader::DEFAULT_BLOCK_SIZE,
+		   nbInflateThreads);
+  else
   {
-    cerr << "ERROR: can't open file " << inFile << endl;
-    exit (1);
+    if (! utils::isBgzf (inFile))
+    {
+      cerr << "ERROR: with --region, file " << inFile << " should be in the"
+	   << " BGZF format (eg. sort it, then compress it with bgzip)" << endl;
+      exit (1);
+    }
+    utils::TabixFormat format = utils::TABIX_IMPUTE;
+    format.skip = (hasHeader ? 1 : 0);
+    index.open (inFile, format);
+    regionReader.open (inFile, index);
+    regionReader.seek (region);
+    if (hasHeader)
+      inReader.open (inFile); // for the header only
   }
   
   ss.clear();
   ss.str(string());  // http://stackoverflow.com/a/834631/597069
-  ss << output << ".bimbam";
+  ss << output << (type == DOSAGE_TEXT ? ".bimbam" : ".dosage")
+     << (isGzipped ? ".gz" : "");
   string outFile1 = ss.str();
-  outStream1.open (outFile1.c_str());
-  if (! outStream1.is_open())
-  {
-    cerr << "ERROR: can't open file " << outFile1 << endl;
-    exit (1);
-  }
   ss.clear();
   ss.str(string());
-  ss << output << "_snpAnnot.txt";
+  ss << output << "_snpAnnot.txt" << (isGzipped ? ".gz" : "");
   string outFile2 = ss.str();
-  outStream2.open (outFile2.c_str());
-  if (! outStream2.is_open())
+  if (isGzipped)
   {
-    cerr << "ERROR: can't open file " << outFile2 << endl;
-    exit (1);
+    outWriter1.open (outFile1, pool.size(), Z_DEFAULT_COMPRESSION, &pool);
+    outWriter2.open (outFile2, pool.size(), Z_DEFAULT_COMPRESSION, &pool);
+    outStream1.open (&outWriter1);
+    outStream2.open (&outWriter2);
+  }
+  else
+  {
+    outStream1.open (outFile1);
+    outStream2.open (outFile2);
   }
   
-  if (hasHeader)
-    getline (inStream, line);
+  // batches read but not written yet, in the order of the input
+  const size_t maxBatches = 2 * pool.size() + 2;
+  deque<ConvertBatch *> batches, freeBatches;
+  bool inputEnd = false;
+  mutex mtx;
+  condition_variable cond;
+  vector<size_t> vIdxIndsToKeep; // set before the first batch is submitted
+  size_t nbSamples = 0, nbSnps = 0, nbLines = 0;
+  if (type != DOSAGE_TEXT)
+    writeDosageHeader (outStream1, type, 0, 0, false);
   
-  while (inStream.good())
+  thread reader ([&] () {
+      string header;
+      vector<utils::Field> tokens;
+      const char * ptLine;
+      size_t len, lineId = 0;
+      bool isLast = false;
+      if (hasHeader)
+      {
+	inReader.getline (header);
+	++lineId;
+      }
+      const size_t lineId_first = lineId + 1;
+      while (true)
+      {
+	ConvertBatch * batch;
+	{
+	  unique_lock<mutex> lock (mtx);
+	  while (batches.size() >= maxBatches)
+	    cond.wait (lock);
+	  if (freeBatches.empty())
+	    batch = new ConvertBatch;
+	  else
+	  {
+	    batch = freeBatches.back();
+	    freeBatches.pop_back();
+	  }
+	}
+	batch->firstLineId = lineId + 1;
+	batch->nbLines = 0;
+	batch->done = false;
+	while (batch->nbLines < LINES_PER_BATCH && ! isLast)
+	{
+	  if (batch->lines.size() == batch->nbLines)
+	    batch->lines.push_back (string());
+	  ++lineId;
+	  if (! (region.empty() ? inReader.getline (ptLine, len)
+		 : regionReader.getline (ptLine, len)) || len == 0)
+	    isLast = true; // stop at the first empty line
+	  else
+	    batch->lines[batch->nbLines++].assign (ptLine, len);
+	}
+	if (batch->firstLineId == lineId_first && batch->nbLines > 0)
+	{
+	  tokenizeImputeLine (batch->lines[0], tokens);
+	  nbSamples = tokens.size() < 5 ? 0 : (tokens.size() - 5) / 3;
+	  getSamplesToKeep (selection, header, nbSamples, inFile,
+			    vIdxIndsToKeep);
+	}
+	{
+	  lock_guard<mutex> lock (mtx);
+	  batches.push_back (batch);
+	  inputEnd = isLast;
+	}
+	cond.notify_all ();
+	pool.submit ([&, batch] () {
+	    convertBatch (*batch, vIdxIndsToKeep, nbSamples, type, precision,
+			  filter, inFile);
+	    lock_guard<mutex> lock (mtx); // cond may go as soon as it is done
+	    batch->done = true;
+	    cond.notify_all ();
+	  });
+	if (isLast)
+	  break;
+      }
+    });
+  
+  while (true)
   {
-    getline (inStream, line);
-    if (line.empty())
-      break;
-    
-    if (line.find('\t') != string::npos)
-      split (line, '\t', tokens);
-    else
-      split (line, ' ', tokens);
-    
-    outStream1 << tokens[1]           // SNP id
-	       << " " << tokens[3]    // allele A (minor allele for BimBam)
-	       << " " << tokens[4];   // allele B (major allele for BimBam)
-    nbSamples = (size_t) floor ((tokens.size() - 5) / 3);
-    for (size_t i = 0; i < nbSamples; ++i)
+    ConvertBatch * batch;
+    {
+      unique_lock<mutex> lock (mtx);
+      while (! (! batches.empty() && batches.front()->done)
+	     && ! (batches.empty() && inputEnd))
+	cond.wait (lock);
+      if (batches.empty())
+	break;
+      batch = batches.front();
+    }
+    if (! batch->error.empty())
+    {
+      cerr << batch->error << endl;
+      exit (1);
+    }
+    outStream1.write (batch->dosages);
+    outStream2.write (batch->snpAnnot);
+    nbSnps += batch->nbSnps;
+    nbLines += batch->nbLines;
     {
-      if (vIdxIndsToSkip.size() > 0 &
-	  find(vIdxIndsToSkip.begin(), vIdxIndsToSkip.end(), i) !=
-	  vIdxIndsToSkip.end())
-	continue;
-      outStream1 << " " << 2 * atof(tokens[5+3*i].c_str())
-	+ 1 * atof(tokens[5+3*i+1].c_str())
-	+ 0 * atof(tokens[5+3*i+2].c_str());
+      lock_guard<mutex> lock (mtx);
+      batches.pop_front();
+      freeBatches.push_back (batch);
     }
-    outStream1 << endl;
-    outStream2 << tokens[1]          // SNP id
-	       << " " << tokens[2]   // SNP coordinate
-	       << " " << tokens[0]   // chromosome
-	       << endl;
+    cond.notify_all ();
   }
+  reader.join ();
+  for (size_t i = 0; i < freeBatches.size(); ++i)
+    delete freeBatches[i];
+  if (verbose > 0 && (filter.minInfo > 0 || filter.minMaf > 0))
+    cout << "nb of SNPs kept in file '" + inFile + "': "
+      + utils::toString (nbSnps) + " out of " + utils::toString (nbLines)
+      + "\n" << flush;
+  
+  if (type != DOSAGE_TEXT)
+    writeDosageHeader (outStream1, type, nbSnps, vIdxIndsToKeep.size(),
+		       true);
   
-  inStream.close();
+  if (inReader.eof()) // otherwise, the rest after an empty line is ignored
+    inReader.close();
+  regionReader.close();
   outStream1.close();
   outStream2.close();
+  if (isGzipped)
+  {
+    outWriter1.close();
+    outWriter2.close();
+  }
+  
+  if (transposeMemory > 0)
+  {
+    string outFile3 = output + "_transposed.bimbam"
+      + (isGzipped ? ".gz" : "");
+    if (verbose > 0)
+      cout << "transpose dosages into file '" + outFile3 + "' ...\n"
+	   << flush;
+    utils::BgzfWriter outWriter3;
+    utils::BufferedWriter outStream3;
+    if (isGzipped)
+    {
+      outWriter3.open (outFile3, pool.size(), Z_DEFAULT_COMPRESSION, &pool);
+      outStream3.open (&outWriter3);
+    }
+    else
+      outStream3.open (outFile3);
+    utils::transposeFile (outFile1, outStream3, transposeMemory,
+			  output + "_transposed", utils::DELIMS_SPACE);
+    outStream3.close();
+    if (isGzipped)
+      outWriter3.close();
+  }
+}
+
+/** \brief Return the output prefix of a file converted in batch mode:
+ *  the given prefix, then the name of the file without '.gz' and '.impute'.
+ */
+static string
+getOutputPrefix (
+  const string & output,
+  const string & inFile)
+{
+  string name = inFile.substr (inFile.find_last_of('/') + 1);
+  const char * exts[] = {".gz", ".impute"};
+  for (size_t i = 0; i < 2; ++i)
+    if (name.size() > strlen(exts[i])
+	&& name.compare (name.size() - strlen(exts[i]), string::npos,
+			 exts[i]) == 0)
+      name.resize (name.size() - strlen(exts[i]));
+  return output + name;
+}
+
+/** \brief Convert all files matching a pattern, the largest first.
+ *  \note As many files as threads are converted at once, but their lines
+ *  are converted by a single pool, so that the threads stay busy until
+ *  the end even if the last files are fewer than the threads.
+ */
+void convertImputeFilesToBimbamFiles (
+  const string pattern,
+  const string output,
+  const string region,
+  const SampleSelection & selection,
+  const bool hasHeader,
+  const size_t nbThreads,
+  const DosageType type,
+  const int precision,
+  const SnpFilter & filter,
+  const size_t transposeMemory,
+  const bool isGzipped,
+  const int verbose)
+{
+  vector<string> vInFiles = utils::glob (pattern);
+  if (vInFiles.empty())
+  {
+    cerr << "ERROR: no file matches " << pattern << endl;
+    exit (1);
+  }
+  
+  vector<pair<off_t, string> > vSizedFiles;
+  map<string, string> mPrefixes;
+  for (size_t i = 0; i < vInFiles.size(); ++i)
+  {
+    struct stat st;
+    if (stat (vInFiles[i].c_str(), &st) != 0 || ! S_ISREG(st.st_mode))
+    {
+      if (verbose > 0)
+	cout << "skip " << vInFiles[i] << ", not a regular file" << endl;
+      continue;
+    }
+    vSizedFiles.push_back (make_pair (- st.st_size, vInFiles[i]));
+    string prefix = getOutputPrefix (output, vInFiles[i]);
+    if (mPrefixes.find (prefix) != mPrefixes.end())
+    {
+      cerr << "ERROR: files " << mPrefixes[prefix] << " and " << vInFiles[i]
+	   << " would have the same output prefix " << prefix << endl;
+      exit (1);
+    }
+    mPrefixes[prefix] = vInFiles[i];
+  }
+  if (vSizedFiles.empty())
+  {
+    cerr << "ERROR: no file matches " << pattern << endl;
+    exit (1);
+  }
+  sort (vSizedFiles.begin(), vSizedFiles.end());
+  if (verbose > 0)
+    cout << "nb of files to convert: " << vSizedFiles.size() << endl;
+  
+  utils::ThreadPool pool (nbThreads);
+  size_t next = 0;
+  mutex mtx;
+  vector<thread> drivers (min (nbThreads, vSizedFiles.size()));
+  const size_t memoryPerFile = (drivers.empty() ? transposeMemory
+				: transposeMemory / drivers.size());
+  for (size_t d = 0; d < drivers.size(); ++d)
+    drivers[d] = thread ([&] () {
+	while (true)
+	{
+	  size_t i;
+	  {
+	    lock_guard<mutex> lock (mtx);
+	    i = next++;
+	  }
+	  if (i >= vSizedFiles.size())
+	    break;
+	  const string & inFile = vSizedFiles[i].second;
+	  convertImputeFileToBimbamFiles (inFile,
+					  getOutputPrefix (output, inFile),
+					  region, selection, hasHeader, 1,
+					  type, precision, filter,
+					  memoryPerFile, isGzipped, pool,
+					  verbose);
+	}
+      });
+  for (size_t d = 0; d < drivers.size(); ++d)
+    drivers[d].join ();
 }
 
 int main (int argc, char ** argv)
 {
-  string inFile, output, indsFile;
+  string inFile, pattern, output, region, indsFile, keepFile, excludeFile;
   bool hasHeader = false;
+  size_t nbThreads = 1;
+  string binaryType;
+  int precision = 6;
+  SnpFilter filter = {0, 0};
+  bool isTransposed = false;
+  size_t memory = 1024;
+  bool isGzipped = false;
   int verbose = 1;
-  parse_args (argc, argv, inFile, output, indsFile, hasHeader, verbose);
+  parse_args (argc, argv, inFile, pattern, output, region, indsFile,
+	      keepFile, excludeFile, hasHeader, nbThreads, binaryType,
+	      precision, filter, isTransposed, memory, isGzipped, verbose);
   
   time_t startRawTime, endRawTime;
   if (verbose > 0)
@@ -263,11 +1128,31 @@ int main (int argc, char ** argv)
 	 << endl;
   }
   
-  vector<size_t> vIdxIndsToSkip = loadOneColumnFileAsNumbers (indsFile,
-							      verbose);
+  SampleSelection selection;
+  loadOneColumnFileAsNumbers (indsFile, selection.idxToSkip, verbose);
+  loadOneColumnFile (keepFile, selection.namesToKeep, verbose);
+  loadOneColumnFile (excludeFile, selection.namesToSkip, verbose);
   
-  convertImputeFileToBimbamFiles (inFile, output, vIdxIndsToSkip, hasHeader,
-				  verbose);
+  const size_t transposeMemory = (isTransposed ? memory << 20 : 0);
+  DosageType type = DOSAGE_TEXT;
+  if (binaryType == "float32")
+    type = DOSAGE_FLOAT32;
+  else if (binaryType == "uint8")
+    type = DOSAGE_UINT8;
+  
+  if (! pattern.empty())
+    convertImputeFilesToBimbamFiles (pattern, output, region, selection,
+				     hasHeader, nbThreads, type, precision,
+				     filter, transposeMemory, isGzipped,
+				     verbose);
+  else
+  {
+    utils::ThreadPool pool (nbThreads);
+    convertImputeFileToBimbamFiles (inFile, output, region, selection,
+				    hasHeader, nbThreads, type, precision,
+				    filter, transposeMemory, isGzipped, pool,
+				    verbose);
+  }
   
   if (verbose > 0)
   {
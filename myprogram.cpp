@@ -26,7 +26,7 @@
  *
  * Versioning: https://github.com/timflutre/...
  *
- *  Compile with: g++ -Wall -g utils_io.cpp myprogram.cpp -lgsl -lgslcblas -lz -o myprogram
+ *  Compile with: g++ -Wall -g -std=c++11 -pthread utils_io.cpp myprogram.cpp -lgsl -lgslcblas -lz -o myprogram
  *  "-lgsl -lgslcblas" are just provided as example
  */
 
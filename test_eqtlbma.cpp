@@ -16,7 +16,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
- *  g++ -Wall -Wextra -g utils.cpp test_eqtlbma.cpp -lgsl -lgslcblas -lz -o test_eqtlbma
+ *  g++ -Wall -Wextra -g -std=c++11 -pthread utils.cpp utils_io.cpp test_eqtlbma.cpp -lgsl -lgslcblas -lz -o test_eqtlbma
  */
 
 #include <cmath>
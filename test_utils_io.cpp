@@ -0,0 +1,1084 @@
+/** \file test_utils_io.cpp
+ *
+ *  `test_utils_io' tests functions from `utils_io'.
+ *  Copyright (C) 2013 Timothee Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  g++ -Wall -Wextra -g -std=c++11 -pthread utils_io.cpp test_utils_io.cpp -lz -o test_utils_io
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+using namespace std;
+
+#include "utils_io.hpp"
+using namespace utils;
+
+void
+test_LineReader_prepData (
+  const string & pathToFile,
+  const char * mode,
+  vector<string> & vLines_exp)
+{
+  vLines_exp.push_back ("chr1\t10\t20\tname1");
+  vLines_exp.push_back ("");
+  vLines_exp.push_back (string(100, 'x')); // longer than the block size
+  vLines_exp.push_back ("last line without end-of-line");
+
+  gzFile stream;
+  openFile (pathToFile, stream, mode);
+  for (size_t i = 0; i < vLines_exp.size(); ++i)
+  {
+    string line = vLines_exp[i];
+    if (i + 1 < vLines_exp.size())
+      line += "\n";
+    gzwriteLine (stream, line, pathToFile, i+1);
+  }
+  closeFile (pathToFile, stream);
+}
+
+void
+test_LineReader_checkOut (
+  const vector<string> & vLines_exp,
+  const vector<string> & vLines_obs)
+{
+  if (vLines_obs.size() != vLines_exp.size())
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    cerr << "vLines_obs.size() (" << vLines_obs.size() << ") != vLines_exp.size() (" << vLines_exp.size() << ")" << endl;
+    exit (1);
+  }
+  for (size_t i = 0; i < vLines_exp.size(); ++i)
+    if (vLines_obs[i].compare(vLines_exp[i]) != 0)
+    {
+      cerr << "ERROR: in " << __FUNCTION__ << endl;
+      cerr << "vLines_obs[" << i << "] (" << vLines_obs[i] << ") != vLines_exp[" << i << "] (" << vLines_exp[i] << ")" << endl;
+      exit (1);
+    }
+}
+
+void
+test_LineReader (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  vector<string> vFileNames;
+  vFileNames.push_back ("test_LineReader.txt.gz");
+  vFileNames.push_back ("test_LineReader.txt");
+  const char * modes[] = {"wb", "wbT"}; // gzipped, then plain text
+
+  for (size_t f = 0; f < vFileNames.size(); ++f)
+  {
+    vector<string> vLines_exp;
+    test_LineReader_prepData (vFileNames[f], modes[f], vLines_exp);
+
+    // small block size to force the buffer to be refilled and grown
+    vector<string> vLines_obs;
+    string line;
+    LineReader reader (vFileNames[f], 16);
+    while (reader.getline (line))
+      vLines_obs.push_back (line);
+    reader.close ();
+    test_LineReader_checkOut (vLines_exp, vLines_obs);
+
+    vLines_obs.clear ();
+    readFile (vFileNames[f], vLines_obs);
+    test_LineReader_checkOut (vLines_exp, vLines_obs);
+
+    LineArray lines;
+    readFile (vFileNames[f], lines);
+    vLines_obs.clear ();
+    for (size_t i = 0; i < lines.size(); ++i)
+      vLines_obs.push_back (lines.str(i));
+    test_LineReader_checkOut (vLines_exp, vLines_obs);
+  }
+
+  removeFiles (vFileNames);
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+/** \brief Write a BGZF file by hand, to be independent from the writer
+ *  of utils_io.
+ */
+void
+test_BgzfSource_writeBgzf (
+  const string & pathToFile,
+  const string & data)
+{
+  FILE * file = fopen (pathToFile.c_str(), "wb");
+  for (size_t start = 0; start < data.size() + 1000; start += 1000)
+  {
+    // the last block is empty, as the EOF marker of bgzip
+    size_t len = start < data.size() ?
+      min ((size_t) 1000, data.size() - start) : 0;
+    vector<unsigned char> cdata (compressBound (len) + 6);
+    z_stream strm;
+    memset (&strm, 0, sizeof(strm));
+    deflateInit2 (&strm, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    strm.next_in = (Bytef *) data.data() + min (start, data.size());
+    strm.avail_in = len;
+    strm.next_out = &cdata[0];
+    strm.avail_out = cdata.size();
+    deflate (&strm, Z_FINISH);
+    size_t clen = strm.total_out;
+    deflateEnd (&strm);
+    uint32_t bsize = 18 + clen + 8 - 1,
+      crc = crc32 (0L, (const Bytef *) data.data() + min (start, data.size()),
+		   len);
+    unsigned char header[18] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0,
+				'B', 'C', 2, 0, (unsigned char) (bsize & 255),
+				(unsigned char) (bsize >> 8)};
+    unsigned char trailer[8];
+    for (int i = 0; i < 4; ++i)
+    {
+      trailer[i] = (crc >> (8*i)) & 255;
+      trailer[4+i] = ((uint32_t) len >> (8*i)) & 255;
+    }
+    fwrite (header, 1, 18, file);
+    fwrite (&cdata[0], 1, clen, file);
+    fwrite (trailer, 1, 8, file);
+  }
+  fclose (file);
+}
+
+void
+test_BgzfSource (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  vector<string> vFileNames;
+  vFileNames.push_back ("test_BgzfSource.txt.gz");
+  vector<string> vLines_exp;
+  string data;
+  for (size_t i = 0; i < 20000; ++i)
+  {
+    vLines_exp.push_back (string("line") + toString(i)
+			  + string(i % 37, 'x'));
+    data += vLines_exp.back() + "\n";
+  }
+  test_BgzfSource_writeBgzf (vFileNames[0], data);
+
+  if (! isBgzf (vFileNames[0]))
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    cerr << vFileNames[0] << " not detected as BGZF" << endl;
+    exit (1);
+  }
+
+  const size_t nbThreads[] = {1, 4};
+  for (size_t t = 0; t < 2; ++t)
+  {
+    vector<string> vLines_obs;
+    string line;
+    LineReader reader (vFileNames[0], 4096, nbThreads[t]);
+    while (reader.getline (line))
+      vLines_obs.push_back (line);
+    reader.close ();
+    test_LineReader_checkOut (vLines_exp, vLines_obs);
+  }
+
+  removeFiles (vFileNames);
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_PrefetchSource (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  vector<string> vFileNames;
+  vFileNames.push_back ("test_PrefetchSource.bin");
+  vFileNames.push_back ("test_PrefetchSource.txt.gz");
+  string data_exp;
+  srand (1859);
+  for (size_t i = 0; i < 100000; ++i)
+    data_exp += (char) (rand() % 256);
+  FILE * file = fopen (vFileNames[0].c_str(), "wb");
+  fwrite (data_exp.data(), 1, data_exp.size(), file);
+  fclose (file);
+
+  // blocks smaller than the reads, and conversely, with a ring of 1 or more
+  const size_t blockSizes[] = {1, 999, 1 << 20};
+  const size_t nbBlocks[] = {1, 3};
+  for (size_t b = 0; b < 3; ++b)
+    for (size_t n = 0; n < 2; ++n)
+    {
+      PrefetchSource src (vFileNames[0], blockSizes[b], nbBlocks[n]);
+      string data_obs;
+      char buf[5000];
+      size_t nbRead;
+      while ((nbRead = src.read (buf, 1 + rand() % sizeof(buf))) > 0)
+	data_obs.append (buf, nbRead);
+      src.close ();
+      if (data_obs != data_exp)
+      {
+	cerr << "ERROR: in " << __FUNCTION__ << endl;
+	cerr << "blocks of " << blockSizes[b] << " bytes, " << nbBlocks[n]
+	     << " ahead: " << data_obs.size() << " bytes read instead of "
+	     << data_exp.size() << endl;
+	exit (1);
+      }
+    }
+
+  // two gzip members followed by garbage, ignored as gzread does
+  data_exp = "";
+  for (size_t m = 0; m < 2; ++m)
+  {
+    gzFile gz = gzopen (vFileNames[1].c_str(), m == 0 ? "wb" : "ab");
+    for (size_t i = 0; i < 5000; ++i)
+    {
+      string line = toString(m) + " " + toString(i) + "\n";
+      gzwrite (gz, line.data(), line.size());
+      data_exp += line;
+    }
+    gzclose (gz);
+  }
+  file = fopen (vFileNames[1].c_str(), "ab");
+  fputs ("garbage", file);
+  fclose (file);
+  GzSource src (vFileNames[1]);
+  string data_obs;
+  char buf[777];
+  size_t nbRead;
+  while ((nbRead = src.read (buf, sizeof(buf))) > 0)
+    data_obs.append (buf, nbRead);
+  src.close ();
+  if (data_obs != data_exp)
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    cerr << "inflated " << data_obs.size() << " bytes instead of "
+	 << data_exp.size() << endl;
+    exit (1);
+  }
+
+  removeFiles (vFileNames);
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_BgzfWriter (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  vector<string> vFileNames;
+  vFileNames.push_back ("test_BgzfWriter.txt.gz");
+  vector<string> vLines_exp;
+  BgzfWriter writer (vFileNames[0], 3);
+  for (size_t i = 0; i < 200000; ++i)
+  {
+    vLines_exp.push_back (toString(i) + "\t" + toString(i * 7919 % 10007));
+    writer.writeLine (vLines_exp.back());
+  }
+  writer.close ();
+
+  if (! isBgzf (vFileNames[0]))
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    cerr << vFileNames[0] << " not detected as BGZF" << endl;
+    exit (1);
+  }
+
+  // read back with zlib only, then in parallel
+  vector<string> vLines_obs;
+  readFile (vFileNames[0], vLines_obs);
+  test_LineReader_checkOut (vLines_exp, vLines_obs);
+
+  vLines_obs.clear ();
+  string line;
+  LineReader reader (vFileNames[0], LineReader::DEFAULT_BLOCK_SIZE, 4);
+  while (reader.getline (line))
+    vLines_obs.push_back (line);
+  reader.close ();
+  test_LineReader_checkOut (vLines_exp, vLines_obs);
+
+  // whole file at once, its size being read from the BGZF blocks
+  LineArray lines;
+  readFile (vFileNames[0], lines);
+  vLines_obs.clear ();
+  for (size_t i = 0; i < lines.size(); ++i)
+    vLines_obs.push_back (lines.str(i));
+  test_LineReader_checkOut (vLines_exp, vLines_obs);
+
+  removeFiles (vFileNames);
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_GzIndex (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  vector<string> vFileNames;
+  vFileNames.push_back ("test_GzIndex.txt.gz");
+  vFileNames.push_back (GzIndex::getPath (vFileNames[0]));
+  vFileNames.push_back ("test_GzIndex_bgzf.txt.gz");
+  vFileNames.push_back (GzIndex::getPath (vFileNames[2]));
+  vector<string> vLines_exp;
+  vector<size_t> vOffsets_exp; // of each line in the inflated data
+  string data;
+  srand (1859);
+  gzFile gz = gzopen (vFileNames[0].c_str(), "wb");
+  BgzfWriter writer (vFileNames[2]);
+  for (size_t i = 0; i < 100000; ++i)
+  {
+    vLines_exp.push_back (toString(i) + string(rand() % 50, 'a' + rand() % 26));
+    vOffsets_exp.push_back (data.size());
+    data += vLines_exp.back() + "\n";
+    gzwrite (gz, vLines_exp.back().data(), vLines_exp.back().size());
+    gzwrite (gz, "\n", 1);
+    writer.writeLine (vLines_exp.back());
+  }
+  gzclose (gz);
+  writer.close ();
+
+  for (size_t f = 0; f < 4; f += 2)
+  {
+    GzIndex index;
+    index.open (vFileNames[f], 1 << 16); // built and saved
+    if (index.size() < 10 || index.nbLines() != vLines_exp.size()
+	|| index.inflatedSize() != data.size())
+    {
+      cerr << "ERROR: in " << __FUNCTION__ << endl;
+      cerr << vFileNames[f] << ": " << index.size() << " checkpoints, "
+	   << index.nbLines() << " lines, " << index.inflatedSize() << " bytes"
+	   << endl;
+      exit (1);
+    }
+    size_t nbCheckpoints = index.size();
+    if (! index.load (vFileNames[f]) || index.size() != nbCheckpoints)
+    {
+      cerr << "ERROR: in " << __FUNCTION__ << endl;
+      cerr << "can't load back the index of " << vFileNames[f] << endl;
+      exit (1);
+    }
+
+    for (size_t nbThreads = 1; nbThreads <= 4; nbThreads += 3)
+    {
+      LineReader reader (vFileNames[f], 4096, nbThreads);
+      string line;
+      for (size_t iter = 0; iter < 200; ++iter)
+      {
+	size_t lineId = rand() % (vLines_exp.size() + 1);
+	reader.seekLine (index, lineId);
+	bool isRead = reader.getline (line);
+	if (lineId == vLines_exp.size() ? isRead
+	    : (! isRead || line != vLines_exp[lineId]
+	       || reader.lineId() != lineId + 1))
+	{
+	  cerr << "ERROR: in " << __FUNCTION__ << endl;
+	  cerr << vFileNames[f] << ": line " << lineId << " read as '" << line
+	       << "' (" << reader.lineId() << ")" << endl;
+	  exit (1);
+	}
+
+	size_t offset = rand() % data.size();
+	reader.seekOffset (index, offset);
+	size_t lineId_exp = upper_bound (vOffsets_exp.begin(),
+					 vOffsets_exp.end(), offset)
+	  - vOffsets_exp.begin() - 1;
+	if (reader.lineId() != lineId_exp || ! reader.getline (line)
+	    || line != data.substr (offset, line.size())
+	    || data[offset + line.size()] != '\n')
+	{
+	  cerr << "ERROR: in " << __FUNCTION__ << endl;
+	  cerr << vFileNames[f] << ": offset " << offset << " read as '"
+	       << line << "' (" << reader.lineId() << ")" << endl;
+	  exit (1);
+	}
+      }
+      reader.close (); // not at the end, but it was seeked
+    }
+  }
+
+  removeFiles (vFileNames);
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+/** \brief Reference tokenizer, one character at a time.
+ */
+void
+test_tokenize_naive (
+  const string & s,
+  const string & delims,
+  const bool & keepEmpty,
+  vector<string> & vTokens)
+{
+  string token;
+  bool inToken = false;
+  vTokens.clear ();
+  for (size_t i = 0; i < s.size(); ++i)
+  {
+    if (delims.find(s[i]) != string::npos)
+    {
+      if (keepEmpty || inToken)
+	vTokens.push_back (token);
+      token.clear ();
+      inToken = false;
+    }
+    else
+    {
+      token += s[i];
+      inToken = true;
+    }
+  }
+  if (inToken)
+    vTokens.push_back (token);
+}
+
+void
+test_tokenize (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  const char alphabet[] = "ab \t,";
+  const DelimSet delimSets[] = {DELIMS_SPACE, DELIMS_WHITESPACE, DELIMS_COLUMN,
+				DelimSet(" \t,;:"), DelimSet(",")};
+  const char * delimChars[] = {" ", " \t", " \t,", " \t,;:", ","};
+  vector<Field> vFields;
+  vector<string> vTokens_exp;
+  srand (1859);
+
+  for (size_t iter = 0; iter < 2000; ++iter)
+  {
+    string s;
+    size_t len = rand() % 70;
+    for (size_t i = 0; i < len; ++i)
+      s += alphabet[rand() % 5];
+    for (size_t d = 0; d < 5; ++d)
+    {
+      for (int keepEmpty = 0; keepEmpty < 2; ++keepEmpty)
+      {
+	test_tokenize_naive (s, delimChars[d], keepEmpty, vTokens_exp);
+	tokenize (s, delimSets[d], vFields, keepEmpty);
+	bool ok = (vFields.size() == vTokens_exp.size());
+	for (size_t i = 0; ok && i < vFields.size(); ++i)
+	  ok = (s.compare (vFields[i].off, vFields[i].len, vTokens_exp[i]) == 0);
+	if (! ok)
+	{
+	  cerr << "ERROR: in " << __FUNCTION__ << endl;
+	  cerr << "tokenize('" << s << "', '" << delimChars[d] << "', "
+	       << keepEmpty << ") gives " << vFields.size() << " tokens instead of "
+	       << vTokens_exp.size() << endl;
+	  exit (1);
+	}
+	for (size_t i = 0; i <= vTokens_exp.size(); ++i)
+	{
+	  Field field;
+	  bool isFound = findToken (s.data(), s.size(), delimSets[d], i, field,
+				    keepEmpty);
+	  if (isFound != (i < vTokens_exp.size())
+	      || (isFound && s.compare (field.off, field.len, vTokens_exp[i])
+		  != 0))
+	  {
+	    cerr << "ERROR: in " << __FUNCTION__ << endl;
+	    cerr << "findToken('" << s << "', '" << delimChars[d] << "', " << i
+		 << ", " << keepEmpty << ") gives the wrong token" << endl;
+	    exit (1);
+	  }
+	}
+      }
+    }
+  }
+
+  // caller-owned array smaller than the number of tokens
+  Field fields[2];
+  string s ("a b c");
+  if (tokenize (s.c_str(), s.size(), DELIMS_SPACE, fields, 2) != 3
+      || fields[1].off != 2 || fields[1].len != 1)
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    exit (1);
+  }
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_StringIndex (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  StringIndex index;
+  SizeIndex numbers;
+  map<string, size_t> mPositions_exp;
+  map<size_t, size_t> mNumbers_exp;
+  vector<string> vKeys_exp;
+  srand (1859);
+  for (size_t i = 0; i < 50000; ++i)
+  {
+    size_t n = rand() % 20000;
+    string key = "rs" + toString(n) + string(n % 13, 'x');
+    if (n % 100 == 0)
+      key.clear (); // the empty string is a valid key
+    bool isNew_exp = (mPositions_exp.find(key) == mPositions_exp.end());
+    if (isNew_exp)
+    {
+      mPositions_exp[key] = vKeys_exp.size();
+      vKeys_exp.push_back (key);
+    }
+    if (mNumbers_exp.find(n) == mNumbers_exp.end())
+    {
+      size_t pos = mNumbers_exp.size();
+      mNumbers_exp[n] = pos;
+    }
+    bool isNew;
+    size_t pos = index.insert (key.data(), key.size(), isNew);
+    if (pos != mPositions_exp[key] || isNew != isNew_exp)
+    {
+      cerr << "ERROR: in " << __FUNCTION__ << endl;
+      cerr << "position of " << key << " is " << pos << " instead of "
+	   << mPositions_exp[key] << endl;
+      exit (1);
+    }
+    if (numbers.insert (n, isNew) != mNumbers_exp[n])
+    {
+      cerr << "ERROR: in " << __FUNCTION__ << endl;
+      cerr << "position of " << n << " is wrong" << endl;
+      exit (1);
+    }
+  }
+  test_LineReader_checkOut (vKeys_exp, index.strings());
+  if (index.find ("absent") != StringIndex::npos
+      || numbers.find (20000) != SizeIndex::npos
+      || numbers.size() != mNumbers_exp.size()
+      || ! index.contains (vKeys_exp[7]))
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    exit (1);
+  }
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_StringSet (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  StringSet empty;
+  empty.build ();
+  if (empty.size() != 0 || empty.contains ("") || empty.contains ("rs1"))
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    exit (1);
+  }
+
+  for (size_t bloomBits = 0; bloomBits <= 10; bloomBits += 10)
+  {
+    StringSet set;
+    StringIndex index;
+    bool isNew;
+    srand (1859);
+    for (size_t i = 0; i < 50000; ++i)
+    {
+      size_t n = rand() % 20000;
+      string key = "rs" + toString(n) + string(n % 13, 'x');
+      if (n % 100 == 0)
+	key.clear (); // the empty string is a valid key
+      if (n % 1000 == 1)
+	key += string(300 + n % 7, 'y'); // its length is kept on 4 bytes
+      set.add (key);
+      index.insert (key.data(), key.size(), isNew);
+    }
+    set.build (bloomBits);
+    if (set.size() != index.size() || set.nbSlots() < set.size())
+    {
+      cerr << "ERROR: in " << __FUNCTION__ << endl;
+      cerr << "set of " << set.size() << " strings instead of "
+	   << index.size() << endl;
+      exit (1);
+    }
+    vector<bool> isTaken (set.nbSlots(), false);
+    for (size_t i = 0; i < index.size(); ++i)
+    {
+      size_t slot = set.find (index.str(i));
+      if (slot == StringSet::npos || isTaken[slot])
+      {
+	cerr << "ERROR: in " << __FUNCTION__ << endl;
+	cerr << "string " << index.str(i) << " not found" << endl;
+	exit (1);
+      }
+      isTaken[slot] = true;
+    }
+    for (size_t n = 20000; n < 40000; ++n)
+    {
+      string key = "rs" + toString(n % 20000) + string(n % 13, 'x');
+      if (n % 1000 == 1)
+	key += string(300 + n % 7, 'z');
+      if (set.contains (key) != index.contains (key.data(), key.size()))
+      {
+	cerr << "ERROR: in " << __FUNCTION__ << endl;
+	cerr << "string " << key << " wrongly found or not" << endl;
+	exit (1);
+      }
+    }
+  }
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_parseNumbers_check (
+  const string & s)
+{
+  char * end;
+  double exp = strtod (s.c_str(), &end);
+  bool isNumber_exp = (! s.empty() && s[0] != ' '
+		       && end == s.c_str() + s.size());
+  double obs = 0;
+  bool isNumber_obs = parseDouble (s.data(), s.size(), obs);
+  if (isNumber_obs != isNumber_exp
+      || (isNumber_exp && memcmp (&obs, &exp, sizeof(double)) != 0))
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    cerr << "parseDouble('" << s << "') gives " << isNumber_obs << " "
+	 << obs << " instead of " << isNumber_exp << " " << exp << endl;
+    exit (1);
+  }
+}
+
+void
+test_parseNumbers (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  // fixed precision, as in IMPUTE files, then anything made of these chars
+  const char alphabet[] = "0123456789.e-+";
+  srand (1859);
+  for (size_t iter = 0; iter < 100000; ++iter)
+  {
+    string s;
+    size_t nbInts = rand() % 4, nbDecs = rand() % 7;
+    for (size_t i = 0; i < nbInts; ++i)
+      s += '0' + rand() % 10;
+    s += '.';
+    for (size_t i = 0; i < nbDecs; ++i)
+      s += '0' + rand() % 10;
+    test_parseNumbers_check (s);
+    s.clear ();
+    size_t len = rand() % 25;
+    for (size_t i = 0; i < len; ++i)
+      s += alphabet[rand() % 14];
+    test_parseNumbers_check (s);
+  }
+  const char * specials[] = {"", " 1", "1 ", "-0", "-0.0", "+.5", "5.", ".",
+			     "1e22", "1e23", "9007199254740993", "1e-400",
+			     "1e400", "inf", "-nan", "0x1p3",
+			     "0.1000000000000000055511151231257827",
+			     "123456789012345678901234567890e-10"};
+  for (size_t i = 0; i < sizeof(specials) / sizeof(specials[0]); ++i)
+  {
+    if (string(specials[i]) == "-nan")
+    {
+      double d;
+      if (! parseDouble (specials[i], 4, d) || d == d)
+      {
+	cerr << "ERROR: in " << __FUNCTION__ << endl;
+	cerr << "parseDouble('-nan') should give nan" << endl;
+	exit (1);
+      }
+      continue;
+    }
+    test_parseNumbers_check (specials[i]);
+  }
+
+  const char * sizes[] = {"0", "42", "007", "18446744073709551615",
+			  "18446744073709551616", "", "-1", "1e3", "12a"};
+  const bool isSize_exp[] = {true, true, true, sizeof(size_t) == 8,
+			     false, false, false, false, false};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+  {
+    size_t obs = 0;
+    bool isSize_obs = parseSize (sizes[i], strlen(sizes[i]), obs);
+    if (isSize_obs != isSize_exp[i]
+	|| (isSize_obs && obs != strtoull (sizes[i], NULL, 10)))
+    {
+      cerr << "ERROR: in " << __FUNCTION__ << endl;
+      cerr << "parseSize('" << sizes[i] << "') gives " << isSize_obs << " "
+	   << obs << endl;
+      exit (1);
+    }
+  }
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_formatDouble_check (
+  const double & x,
+  const int & precision)
+{
+  char exp[64], obs[FORMAT_DOUBLE_SIZE + 1];
+  snprintf (exp, sizeof(exp), "%.*g", precision, x);
+  size_t len = formatDouble (obs, x, precision);
+  obs[len] = '\0';
+  if (strcmp (obs, exp) != 0)
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    cerr << "formatDouble(" << exp << ", " << precision << ") gives '" << obs
+	 << "'" << endl;
+    exit (1);
+  }
+}
+
+void
+test_formatDouble (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  // dosages, then numbers of any magnitude, then ties and round numbers
+  srand (1859);
+  for (size_t iter = 0; iter < 100000; ++iter)
+  {
+    test_formatDouble_check ((rand() % 2001) / 1000.0, 6);
+    double x = ((double) rand() / RAND_MAX - 0.5)
+      * pow (10.0, rand() % 40 - 20);
+    test_formatDouble_check (x, 1 + rand() % 17);
+  }
+  const double specials[] = {0.0, -0.0, 0.5, 2.5, 0.125, 1e-4, 9.9999995e-5,
+			     999999.5, 9999995, 0.15, 1e15, 123456789012345.0,
+			     1.0 / 3, INFINITY, -INFINITY, NAN};
+  for (size_t i = 0; i < sizeof(specials) / sizeof(specials[0]); ++i)
+    for (int p = 1; p <= 17; ++p)
+      test_formatDouble_check (specials[i], p);
+
+  // shortest representation reading back the same number
+  const double shortest[] = {0.1, 1.0 / 3, 0.1 + 0.2, 1e23, 0.998, -2.0};
+  const char * shortest_exp[] = {"0.1", "0.3333333333333333",
+				 "0.30000000000000004", "1e+23", "0.998",
+				 "-2"};
+  for (size_t i = 0; i < sizeof(shortest) / sizeof(shortest[0]); ++i)
+  {
+    char obs[FORMAT_DOUBLE_SIZE + 1];
+    obs[formatDouble (obs, shortest[i], 0)] = '\0';
+    if (string(obs) != shortest_exp[i])
+    {
+      cerr << "ERROR: in " << __FUNCTION__ << endl;
+      cerr << "formatDouble(" << shortest_exp[i] << ", 0) gives '" << obs
+	   << "'" << endl;
+      exit (1);
+    }
+  }
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_BufferedWriter (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  vector<string> vFileNames;
+  vFileNames.push_back ("test_BufferedWriter.txt");
+  vFileNames.push_back ("test_BufferedWriter.txt.gz");
+
+  // a small buffer, to go through every path, then a header rewritten
+  vector<string> vLines_exp (1, "header");
+  BufferedWriter writer (vFileNames[0], 100);
+  writer.writeLine ("HEADER");
+  for (size_t i = 0; i < 10000; ++i)
+  {
+    vLines_exp.push_back (toString(i) + string(i % 250, 'x') + " "
+			  + toString(i / 7.0));
+    writer.write (toString(i));
+    writer.write (string(i % 250, 'x'));
+    writer.put (' ');
+    writer.writeDouble (i / 7.0);
+    writer.put ('\n');
+  }
+  writer.rewrite (0, "header", 6);
+  writer.close ();
+  vector<string> vLines_obs;
+  readFile (vFileNames[0], vLines_obs);
+  test_LineReader_checkOut (vLines_exp, vLines_obs);
+
+  BgzfWriter bgzf (vFileNames[1], 2);
+  writer.open (&bgzf);
+  for (size_t i = 1; i < vLines_exp.size(); ++i)
+    writer.writeLine (vLines_exp[i]);
+  writer.close ();
+  if (bgzf.nbLines() != vLines_exp.size() - 1)
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    cerr << bgzf.nbLines() << " lines counted instead of "
+	 << vLines_exp.size() - 1 << endl;
+    exit (1);
+  }
+  bgzf.close ();
+  vLines_obs.clear ();
+  readFile (vFileNames[1], vLines_obs);
+  vLines_exp.erase (vLines_exp.begin());
+  test_LineReader_checkOut (vLines_exp, vLines_obs);
+
+  removeFiles (vFileNames);
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_transposeFile (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  vector<string> vFileNames;
+  vFileNames.push_back ("test_transposeFile.txt.gz");
+  vFileNames.push_back ("test_transposeFile_out.txt");
+  const size_t nbRows = 300, nbCols = 150;
+  vector<vector<string> > matrix (nbRows);
+  BgzfWriter writer (vFileNames[0]);
+  for (size_t r = 0; r < nbRows; ++r)
+  {
+    string line;
+    for (size_t c = 0; c < nbCols; ++c)
+    {
+      matrix[r].push_back (toString (r * 7919 % 10007 + c));
+      line += (c == 0 ? "" : (c % 3 == 0 ? "\t" : "  ")) + matrix[r].back();
+    }
+    writer.writeLine (line);
+  }
+  writer.close ();
+  vector<string> vLines_exp;
+  for (size_t c = 0; c < nbCols; ++c)
+  {
+    vLines_exp.push_back (matrix[0][c]);
+    for (size_t r = 1; r < nbRows; ++r)
+      vLines_exp.back() += " " + matrix[r][c];
+  }
+
+  // in memory, then in a tile per line, pasted in two rounds
+  const size_t maxMemories[] = {1 << 24, 1};
+  for (size_t i = 0; i < 2; ++i)
+  {
+    BufferedWriter out (vFileNames[1]);
+    transposeFile (vFileNames[0], out, maxMemories[i], "test_transposeFile");
+    out.close ();
+    vector<string> vLines_obs;
+    readFile (vFileNames[1], vLines_obs);
+    test_LineReader_checkOut (vLines_exp, vLines_obs);
+    if (doesFileExist ("test_transposeFile.tile0"))
+    {
+      cerr << "ERROR: in " << __FUNCTION__ << endl;
+      cerr << "temporary files weren't removed" << endl;
+      exit (1);
+    }
+  }
+
+  removeFiles (vFileNames);
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_TabixIndex (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  vector<string> vFileNames;
+  vFileNames.push_back ("test_TabixIndex.bed.gz");
+  vFileNames.push_back (TabixIndex::getPath (vFileNames[0]));
+
+  // sorted records, a few of them long enough to be in the largest bins
+  const char * seqs[] = {"chr1", "chr2"};
+  vector<string> vLines;
+  vector<size_t> vSeqs, vBegs, vEnds;
+  BgzfWriter writer (vFileNames[0]);
+  writer.writeLine ("#chrom\tstart\tend\tname");
+  for (size_t s = 0, pos = 0; s < 2; ++s, pos = 0)
+    for (size_t i = 0; i < 20000; ++i)
+    {
+      pos += i * 7919 % 301;
+      size_t len = (i % 997 == 0 ? i * 1009 % 3000000 : i % 50);
+      vSeqs.push_back (s);
+      vBegs.push_back (pos);
+      vEnds.push_back (pos + (len == 0 ? 1 : len));
+      vLines.push_back (string(seqs[s]) + "\t" + toString(pos) + "\t"
+			+ toString(pos + len) + "\tn" + toString(i));
+      writer.writeLine (vLines.back());
+    }
+  writer.close ();
+
+  TabixIndex built, loaded;
+  built.open (vFileNames[0]);
+  if (! doesFileExist (vFileNames[1]) || ! loaded.load (vFileNames[0])
+      || loaded.nbSeqs() != 2 || loaded.findSeq ("chr2") != 1
+      || loaded.findSeq ("chr3") != StringIndex::npos)
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    cerr << "index wasn't saved or loaded" << endl;
+    exit (1);
+  }
+
+  // the records overlapping each region, as a full scan would find them
+  RegionReader reader (vFileNames[0], loaded);
+  const char * line;
+  size_t len;
+  for (size_t r = 0; r < 200; ++r)
+  {
+    size_t s = r % 2, rBeg = r * 104729 % 3000000,
+      rEnd = rBeg + r * 37 % 20000 + 1;
+    vector<string> vLines_exp, vLines_obs;
+    for (size_t i = 0; i < vLines.size(); ++i)
+      if (vSeqs[i] == s && vBegs[i] < rEnd && vEnds[i] > rBeg)
+	vLines_exp.push_back (vLines[i]);
+    if (reader.seek (s, rBeg, rEnd))
+      while (reader.getline (line, len))
+	vLines_obs.push_back (string (line, len));
+    test_LineReader_checkOut (vLines_exp, vLines_obs);
+  }
+  reader.close ();
+  removeFiles (vFileNames);
+
+  // SNPs one base long at positions from 1, after a header
+  TabixFormat format = TABIX_SNPANNOT;
+  format.skip = 1;
+  vector<string> vSnps;
+  writer.open (vFileNames[0]);
+  writer.writeLine ("id pos chr");
+  for (size_t i = 1; i <= 50000; ++i)
+  {
+    vSnps.push_back ("rs" + toString(i) + " " + toString(10 * i) + " 22");
+    writer.writeLine (vSnps.back());
+  }
+  writer.close ();
+  built.open (vFileNames[0], format);
+  if (loaded.load (vFileNames[0]) || ! loaded.load (vFileNames[0], format))
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    cerr << "index was loaded with another format" << endl;
+    exit (1);
+  }
+  reader.open (vFileNames[0], loaded);
+  const char * regions[] = {"22:1,000-1,020", "22:499991", "22", "21:1-100",
+			    "22:5-9"};
+  const size_t firsts[] = {100, 50000, 1, 0, 0},
+    lasts[] = {102, 50000, 50000, 0, 0};
+  for (size_t r = 0; r < 5; ++r)
+  {
+    vector<string> vLines_exp, vLines_obs;
+    for (size_t i = firsts[r]; i > 0 && i <= lasts[r]; ++i)
+      vLines_exp.push_back (vSnps[i-1]);
+    if (reader.seek (regions[r]))
+      while (reader.getline (line, len))
+	vLines_obs.push_back (string (line, len));
+    test_LineReader_checkOut (vLines_exp, vLines_obs);
+  }
+  reader.close ();
+  removeFiles (vFileNames);
+
+  // records of 1 kb in more blocks than cached, read one by one backward
+  // then forward, so that a record read from the oldest cached block goes
+  // on in a block to load in its place
+  vector<string> vRecords;
+  writer.open (vFileNames[0]);
+  for (size_t i = 0; i < 20000; ++i)
+  {
+    vRecords.push_back ("chr1\t" + toString(20000 * i) + "\t"
+			+ toString(20000 * i + 1) + "\t"
+			+ string(1000, 'a' + i % 26));
+    writer.writeLine (vRecords.back());
+  }
+  writer.close ();
+  built.open (vFileNames[0]);
+  reader.open (vFileNames[0], built);
+  for (size_t k = 0; k < 2 * vRecords.size(); ++k)
+  {
+    size_t i = (k < vRecords.size() ? vRecords.size() - 1 - k
+		: k - vRecords.size());
+    vector<string> vLines_exp (1, vRecords[i]), vLines_obs;
+    if (reader.seek (0, 20000 * i, 20000 * i + 1))
+      while (reader.getline (line, len))
+	vLines_obs.push_back (string (line, len));
+    test_LineReader_checkOut (vLines_exp, vLines_obs);
+  }
+  reader.close ();
+  removeFiles (vFileNames);
+
+  string seq;
+  uint64_t beg, end;
+  if (! parseRegion ("chr1:2-3", seq, beg, end) || seq != "chr1" || beg != 1
+      || end != 3 || parseRegion ("chr1:0-3", seq, beg, end)
+      || parseRegion ("chr1:3-2", seq, beg, end)
+      || parseRegion (":1-2", seq, beg, end))
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    cerr << "regions aren't parsed as in tabix" << endl;
+    exit (1);
+  }
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+int main (int argc, char ** argv)
+{
+  int verbose;
+  if (argc > 1)
+    verbose = atoi (argv[1]);
+  else
+    verbose = 0;
+
+  test_LineReader (verbose);
+  test_tokenize (verbose);
+  test_PrefetchSource (verbose);
+  test_BgzfSource (verbose);
+  test_BgzfWriter (verbose);
+  test_GzIndex (verbose);
+  test_StringIndex (verbose);
+  test_StringSet (verbose);
+  test_parseNumbers (verbose);
+  test_formatDouble (verbose);
+  test_BufferedWriter (verbose);
+  test_transposeFile (verbose);
+  test_TabixIndex (verbose);
+
+  return EXIT_SUCCESS;
+}
@@ -44,7 +44,6 @@ using namespace std;
   do { if (DEBUG_TEST) fprintf(stderr, fmt, __VA_ARGS__); } while (0)
 
 /** \brief Split a string with one delimiter.
- *  \note http://stackoverflow.com/questions/236129/how-to-split-a-string-in-c/236803#236803
  */
 vector<string> &
 split (
@@ -52,13 +51,7 @@ split (
   char delim,
   vector<string> & tokens)
 {
-  tokens.clear();
-  stringstream ss(s);
-  string item;
-  while(getline(ss, item, delim)) {
-    tokens.push_back(item);
-  }
-  return tokens;
+  return utils::split (s, delim, tokens);
 }
 
 /** \brief Split a string with one delimiter.
@@ -68,8 +61,7 @@ split (
   const string & s,
   char delim)
 {
-  vector<string> tokens;
-  return split (s, delim, tokens);
+  return utils::split (s, delim);
 }
 
 /** \brief Split a string with several delimiters.
@@ -80,15 +72,7 @@ split (
   const char * delim,
   vector<string> & tokens)
 {
-  tokens.clear();
-  char * pch;
-  pch = strtok ((char *) s.c_str(), delim);
-  while (pch != NULL)
-  {
-    tokens.push_back (string(pch));
-    pch = strtok (NULL, delim);
-  }
-  return tokens;
+  return utils::split (s, delim, tokens);
 }
 
 /** \brief Split a string with several delimiters.
@@ -98,15 +82,7 @@ split (
   const string & s,
   const char * delim)
 {
-  vector<string> tokens;
-  char * pch;
-  pch = strtok ((char *) s.c_str(), delim);
-  while (pch != NULL)
-  {
-    tokens.push_back (string(pch));
-    pch = strtok (NULL, delim);
-  }
-  return tokens;
+  return utils::split (s, delim);
 }
 
 /** \brief Split a string with several delimiters and return only the content
@@ -263,22 +239,7 @@ getline (
   gzFile & fileStream,
   string & line)
 {
-  int res = 1, c;
-  line.clear ();
-  while (true)
-  {
-    c = gzgetc (fileStream);
-    if (c == -1) // eof or error
-    {
-      res = 0;
-      break;
-    }
-    else if (c == 10) // 10 is ASCII code for '\n'
-      break;
-    else
-      line.push_back (c);
-  }
-  return res;
+  return utils::getline (fileStream, line);
 }
 
 void
@@ -297,55 +258,118 @@ gzwriteLine (
   }
 }
 
-/** \brief Load a one-column file.
+/** \brief Add an item of a one-column file to an index or to a set.
  */
-vector<string>
-loadOneColumnFile (
+static inline void
+addItem (
+  utils::StringIndex & items,
+  const char * s,
+  const size_t & len)
+{
+  bool isNew;
+  items.insert (s, len, isNew);
+}
+
+static inline void
+addItem (
+  utils::StringSet & items,
+  const char * s,
+  const size_t & len)
+{
+  items.add (s, len);
+}
+
+/** \brief Read the items of a one-column file, skipping those starting
+ *  with '#'.
+ */
+template <class Items>
+static void
+readOneColumnFile (
   const string & inFile,
+  Items & items,
   const int & verbose)
 {
-  vector<string> vItems;
-  
-  if (inFile.empty())
-    return vItems;
-  
-  string line;
-  gzFile stream;
-  vector<string> tokens;
+  const char * line;
+  size_t len;
+  utils::LineReader reader;
+  vector<utils::Field> tokens;
   size_t line_id = 0;
   
-  openFile (inFile, stream, "rb");
+  reader.open (inFile);
   if (verbose > 0)
     cout <<"load file " << inFile << " ..." << endl;
   
-  while (getline (stream, line))
+  while (reader.getline (line, len))
   {
     line_id++;
-    split (line, " \t,", tokens);
+    utils::tokenize (line, len, utils::DELIMS_COLUMN, tokens);
     if (tokens.size() != 1)
     {
       cerr << "ERROR: file " << inFile << " should have only one column"
 	   << " at line " << line_id << endl;
       exit (1);
     }
-    if (tokens[0][0] == '#')
+    if (line[tokens[0].off] == '#')
       continue;
-    if (find(vItems.begin(), vItems.end(), tokens[0]) == vItems.end())
-      vItems.push_back (tokens[0]);
+    addItem (items, line + tokens[0].off, tokens[0].len);
   }
   
-  if (! gzeof (stream))
-  {
-    cerr << "ERROR: can't read successfully file "
-	 << inFile << " up to the end" << endl;
-    exit (1);
-  }
-  closeFile (inFile, stream);
+  reader.close ();
+}
+
+/** \brief Load a one-column file into an index, which keeps the order
+ *  in which items first appear and gives the position of any of them in
+ *  O(1).
+ */
+void
+loadOneColumnFile (
+  const string & inFile,
+  utils::StringIndex & items,
+  const int & verbose)
+{
+  items.clear ();
+  
+  if (inFile.empty())
+    return;
+  
+  readOneColumnFile (inFile, items, verbose);
   
   if (verbose > 0)
-    cout << "items loaded: " << vItems.size() << endl;
+    cout << "items loaded: " << items.size() << endl;
+}
+
+/** \brief Load a one-column file into a static set, only telling whether
+ *  an item is in it, but taking a few bytes per item on top of the items
+ *  for very long lists.
+ */
+void
+loadOneColumnFile (
+  const string & inFile,
+  utils::StringSet & items,
+  const int & verbose)
+{
+  items.clear ();
+  
+  if (inFile.empty())
+    return;
   
-  return vItems;
+  readOneColumnFile (inFile, items, verbose);
+  items.build ();
+  
+  if (verbose > 0)
+    cout << "items loaded: " << items.size() << endl;
+}
+
+/** \brief Load a one-column file.
+ */
+vector<string>
+loadOneColumnFile (
+  const string & inFile,
+  const int & verbose)
+{
+  utils::StringIndex items;
+  loadOneColumnFile (inFile, items, verbose);
+  return items.strings();
 }
 
 /** \brief Load a two-column file.
@@ -360,38 +384,36 @@ loadTwoColumnFile (
   if (inFile.empty())
     return mItems;
   
-  string line;
-  gzFile stream;
-  vector<string> tokens;
+  const char * line;
+  size_t len;
+  utils::LineReader reader;
+  vector<utils::Field> tokens;
+  string key;
   size_t line_id = 0;
   
-  openFile (inFile, stream, "rb");
+  reader.open (inFile);
   if (verbose > 0)
     cout <<"load file " << inFile << " ..." << endl;
   
-  while (getline (stream, line))
+  while (reader.getline (line, len))
   {
     line_id++;
-    split (line, " \t,", tokens);
+    utils::tokenize (line, len, utils::DELIMS_COLUMN, tokens);
     if (tokens.size() != 2)
     {
       cerr << "ERROR: file " << inFile << " should have only two columns"
 	   << " at line " << line_id << endl;
       exit (1);
     }
-    if (tokens[0][0] == '#')
+    if (line[tokens[0].off] == '#')
       continue;
-    if (mItems.find(tokens[0]) == mItems.end())
-      mItems.insert (make_pair (tokens[0], tokens[1]));
+    key.assign (line + tokens[0].off, tokens[0].len);
+    if (mItems.find(key) == mItems.end())
+      mItems.insert (make_pair (key, string(line + tokens[1].off,
+					    tokens[1].len)));
   }
   
-  if (! gzeof (stream))
-  {
-    cerr << "ERROR: can't read successfully file "
-	 << inFile << " up to the end" << endl;
-    exit (1);
-  }
-  closeFile (inFile, stream);
+  reader.close ();
   
   if (verbose > 0)
     cout << "items loaded: " << mItems.size() << endl;
@@ -399,110 +421,148 @@ loadTwoColumnFile (
   return mItems;
 }
 
-/** \brief Load a two-column file.
+/** \brief Load a two-column file, keeping the first value of each key.
+ *  \note Keys already in the index before loading are skipped. The value
+ *  of the key at position i in the index is values[i].
  */
 void
 loadTwoColumnFile (
   const string & inFile,
-  map<string, string> & mItems,
-  vector<string> & vKeys,
+  utils::StringIndex & keys,
+  vector<string> & values,
   const int & verbose)
 {
-  mItems.clear();
+  values.resize (keys.size());
+  
+  if (inFile.empty())
+    return;
   
-  if (! inFile.empty())
+  const char * line;
+  size_t len;
+  utils::LineReader reader;
+  vector<utils::Field> tokens;
+  size_t line_id = 0, nbLoaded = 0;
+  bool isNew;
+  
+  reader.open (inFile);
+  if (verbose > 0)
+    cout <<"load file " << inFile << " ..." << endl;
+  
+  while (reader.getline (line, len))
   {
-    string line;
-    gzFile stream;
-    vector<string> tokens;
-    size_t line_id = 0;
-    
-    openFile (inFile, stream, "rb");
-    if (verbose > 0)
-      cout <<"load file " << inFile << " ..." << endl;
-    
-    while (getline (stream, line))
+    line_id++;
+    utils::tokenize (line, len, utils::DELIMS_COLUMN, tokens);
+    if (tokens.size() != 2)
     {
-      line_id++;
-      split (line, " \t,", tokens);
-      if (tokens.size() != 2)
-      {
-	cerr << "ERROR: file " << inFile << " should have exactly two columns"
-	     << " at line " << line_id << endl;
-	exit (1);
-      }
-      if (tokens[0][0] == '#')
-	continue;
-      if (find (vKeys.begin(), vKeys.end(), tokens[0]) == vKeys.end())
-      {
-	vKeys.push_back (tokens[0]);
-	mItems.insert (make_pair (tokens[0], tokens[1]));
-      }
+      cerr << "ERROR: file " << inFile << " should have exactly two columns"
+	   << " at line " << line_id << endl;
+      exit (1);
     }
-    
-    if (! gzeof (stream))
+    if (line[tokens[0].off] == '#')
+      continue;
+    keys.insert (line + tokens[0].off, tokens[0].len, isNew);
+    if (isNew)
     {
-      cerr << "ERROR: can't read successfully file "
-	   << inFile << " up to the end" << endl;
-      exit (1);
+      values.push_back (string(line + tokens[1].off, tokens[1].len));
+      ++nbLoaded;
     }
-    closeFile (inFile, stream);
-    
-    if (verbose > 0)
-      cout << "items loaded: " << mItems.size() << endl;
   }
+  
+  reader.close ();
+  
+  if (verbose > 0)
+    cout << "items loaded: " << nbLoaded << endl;
 }
 
-/** \brief Load a one-column file into a vector of size_t.
+/** \brief Load a two-column file.
  */
-vector<size_t>
+void
+loadTwoColumnFile (
+  const string & inFile,
+  map<string, string> & mItems,
+  vector<string> & vKeys,
+  const int & verbose)
+{
+  mItems.clear();
+  
+  utils::StringIndex keys;
+  vector<string> values;
+  for (size_t i = 0; i < vKeys.size(); ++i)
+    keys.insert (vKeys[i]);
+  size_t nbKeys = keys.size();
+  loadTwoColumnFile (inFile, keys, values, verbose);
+  
+  for (size_t i = nbKeys; i < keys.size(); ++i)
+  {
+    vKeys.push_back (keys.str(i));
+    mItems.insert (make_pair (vKeys.back(), values[i]));
+  }
+}
+
+/** \brief Load a one-column file of numbers into an index, which keeps
+ *  the order in which they first appear and gives the position of any of
+ *  them in O(1).
+ */
+void
 loadOneColumnFileAsNumbers (
   const string & inFile,
+  utils::SizeIndex & items,
   const int & verbose)
 {
-  vector<size_t> vItems;
+  items.clear ();
   
   if (inFile.empty())
-    return vItems;
+    return;
   
-  string line;
-  gzFile stream;
-  vector<string> tokens;
+  const char * line;
+  size_t len;
+  utils::LineReader reader;
+  vector<utils::Field> tokens;
   size_t line_id = 0;
+  bool isNew;
   
-  openFile (inFile, stream, "rb");
+  reader.open (inFile);
   if (verbose > 0)
     cout <<"load file " << inFile << " ..." << endl;
   
-  while (getline (stream, line))
+  while (reader.getline (line, len))
   {
     line_id++;
-    split (line, " \t,", tokens);
+    utils::tokenize (line, len, utils::DELIMS_COLUMN, tokens);
     if (tokens.size() != 1)
     {
       cerr << "ERROR: file " << inFile << " should have only one column"
 	   << " at line " << line_id << endl;
       exit (1);
     }
-    if (tokens[0][0] == '#')
+    if (line[tokens[0].off] == '#')
       continue;
-    size_t idx = strtoul (tokens[0].c_str(), NULL, 0);
-    if (find(vItems.begin(), vItems.end(), idx) == vItems.end())
-      vItems.push_back (idx);
+    size_t number;
+    if (! utils::parseSize (line + tokens[0].off, tokens[0].len, number))
+    {
+      cerr << "ERROR: file " << inFile << " should have a non-negative"
+	   << " integer at line " << line_id << endl;
+      exit (1);
+    }
+    items.insert (number, isNew);
   }
   
-  if (! gzeof (stream))
-  {
-    cerr << "ERROR: can't read successfully file "
-	 << inFile << " up to the end" << endl;
-    exit (1);
-  }
-  closeFile (inFile, stream);
+  reader.close ();
   
   if (verbose > 0)
-    cout << "items loaded: " << vItems.size() << endl;
-  
-  return vItems;
+    cout << "items loaded: " << items.size() << endl;
+}
+
+/** \brief Load a one-column file into a vector of size_t.
+ */
+vector<size_t>
+loadOneColumnFileAsNumbers (
+  const string & inFile,
+  const int & verbose)
+{
+  utils::SizeIndex items;
+  loadOneColumnFileAsNumbers (inFile, items, verbose);
+  return items.keys();
 }
 
 /** \brief Used by scandir.
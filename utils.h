@@ -34,6 +34,8 @@ using namespace std;
 
 #include "zlib.h"
 
+#include "utils_io.hpp"
+
 vector<string> & split (const string & s, char delim, vector<string> & tokens);
 
 vector<string> split (const string & s, char delim);
@@ -67,15 +69,27 @@ int getline (gzFile & fileStream, string & line);
 void gzwriteLine (gzFile & fileStream, const string & line,
 		  const string & pathToFile, const size_t & lineId);
 
+void loadOneColumnFile (const string & inFile, utils::StringIndex & items,
+			const int & verbose);
+
+void loadOneColumnFile (const string & inFile, utils::StringSet & items,
+			const int & verbose);
+
 vector<string> loadOneColumnFile (const string & inFile,
 				  const int & verbose);
 
 map<string, string> loadTwoColumnFile (const string & inFile,
 				       const int & verbose);
 
+void loadTwoColumnFile (const string & inFile, utils::StringIndex & keys,
+			vector<string> & values, const int & verbose);
+
 void loadTwoColumnFile (const string & inFile, map<string, string> & mItems,
 			vector<string> & vKeys, const int & verbose);
 
+void loadOneColumnFileAsNumbers (const string & inFile,
+				 utils::SizeIndex & items, const int & verbose);
+
 vector<size_t> loadOneColumnFileAsNumbers (const string & inFile,
 					   const int & verbose);
 
@@ -21,10 +21,17 @@
 #include <cstring>
 #include <cmath>
 #include <cerrno>
+#include <cctype>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <dirent.h>
 #include <glob.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <iomanip>
 #include <algorithm>
@@ -45,8 +52,221 @@ namespace utils {
 #define debug_print(fmt, ...)						\
   do { if (DEBUG_TEST) fprintf(stderr, fmt, __VA_ARGS__); } while (0)
 
+/** \brief Return the index of the lowest bit set in a non-null mask.
+ */
+  static inline unsigned
+  lowestBit (
+    uint32_t mask)
+  {
+#ifdef __GNUC__
+    return __builtin_ctz (mask);
+#else
+    unsigned b = 0;
+    while (! ((mask >> b) & 1))
+      ++b;
+    return b;
+#endif
+  }
+
+/** \brief Return a mask with bit i set if s[i] is a delimiter, for the
+ *  16 bytes starting at s.
+ */
+  static inline uint32_t
+  delimMask16 (
+    const char * s,
+    const DelimSet & delims)
+  {
+#ifdef __SSE2__
+    if (delims.size() > 0 && delims.size() <= 4)
+    {
+      __m128i chunk = _mm_loadu_si128 ((const __m128i *) s);
+      __m128i eq = _mm_cmpeq_epi8 (chunk, _mm_set1_epi8 (delims.first()[0]));
+      for (size_t d = 1; d < delims.size(); ++d)
+	eq = _mm_or_si128 (eq, _mm_cmpeq_epi8 (chunk,
+					       _mm_set1_epi8 (delims.first()[d])));
+      return (uint32_t) _mm_movemask_epi8 (eq);
+    }
+#endif
+    uint32_t mask = 0;
+    for (int i = 0; i < 16; ++i)
+      mask |= (uint32_t) delims.has ((unsigned char) s[i]) << i;
+    return mask;
+  }
+
+  struct ArrayFieldSink
+  {
+    Field * fields;
+    size_t maxFields, nbFields;
+    bool operator() (size_t off, size_t len)
+    {
+      if (nbFields < maxFields)
+      {
+	fields[nbFields].off = off;
+	fields[nbFields].len = len;
+      }
+      ++nbFields;
+      return true;
+    }
+  };
+
+  struct VectorFieldSink
+  {
+    vector<Field> * fields;
+    bool operator() (size_t off, size_t len)
+    {
+      Field f = {off, len};
+      fields->push_back (f);
+      return true;
+    }
+  };
+
+  struct NthFieldSink
+  {
+    Field * field;
+    size_t idx, nbFields;
+    bool operator() (size_t off, size_t len)
+    {
+      if (nbFields++ < idx)
+	return true;
+      field->off = off;
+      field->len = len;
+      return false;
+    }
+  };
+
+/** \brief Find the tokens of a line, 16 bytes at a time.
+ *  \note Without keepEmpty, runs of delimiters are collapsed and leading
+ *  or trailing ones are ignored (as with strtok). With keepEmpty, each
+ *  delimiter ends a token, but a trailing one doesn't start a new token
+ *  (as with std::getline). The scan stops as soon as the sink returns
+ *  false.
+ */
+  template <typename Sink>
+  static void
+  tokenizeImpl (
+    const char * s,
+    const size_t & len,
+    const DelimSet & delims,
+    const bool & keepEmpty,
+    Sink & sink)
+  {
+    size_t start = 0;
+    uint32_t carry = 1; // the beginning of the line acts as a delimiter
+    char tail[16];
+    for (size_t pos = 0; pos < len; pos += 16)
+    {
+      uint32_t mask, pad = 0;
+      if (len - pos >= 16)
+	mask = delimMask16 (s + pos, delims);
+      else
+      {
+	memcpy (tail, s + pos, len - pos);
+	mask = delimMask16 (tail, delims) & ~(0xFFFFU << (len - pos));
+	pad = 0xFFFFU << (len - pos) & 0xFFFFU; // past the end of the line
+      }
+      if (keepEmpty)
+      {
+	while (mask)
+	{
+	  size_t b = pos + lowestBit (mask);
+	  if (! sink (start, b - start))
+	    return;
+	  start = b + 1;
+	  mask &= mask - 1;
+	}
+      }
+      else
+      {
+	uint32_t d = mask | pad;
+	uint32_t prev = ((d << 1) | carry) & 0xFFFFU;
+	uint32_t starts = ~d & prev & 0xFFFFU, events = starts | (d & ~prev);
+	carry = (d >> 15) & 1;
+	while (events)
+	{
+	  unsigned b = lowestBit (events);
+	  if ((starts >> b) & 1)
+	    start = pos + b;
+	  else if (! sink (start, pos + b - start))
+	    return;
+	  events &= events - 1;
+	}
+      }
+    }
+    if (keepEmpty)
+    {
+      if (start < len)
+	sink (start, len - start);
+    }
+    else if (carry == 0) // the line ends inside a token
+      sink (start, len - start);
+  }
+
+/** \brief Fill a caller-owned array with the tokens of a line.
+ *  \return the number of tokens in the line, which can be larger than
+ *  maxFields (only the first maxFields ones are then filled)
+ */
+  size_t
+  tokenize (
+    const char * s,
+    const size_t & len,
+    const DelimSet & delims,
+    Field * fields,
+    const size_t & maxFields,
+    const bool & keepEmpty)
+  {
+    ArrayFieldSink sink = {fields, maxFields, 0};
+    tokenizeImpl (s, len, delims, keepEmpty, sink);
+    return sink.nbFields;
+  }
+
+/** \brief Find only the token of a line at a given index, from 0,
+ *  without scanning the rest of the line.
+ *  \return false if the line has fewer tokens
+ */
+  bool
+  findToken (
+    const char * s,
+    const size_t & len,
+    const DelimSet & delims,
+    const size_t & idx,
+    Field & field,
+    const bool & keepEmpty)
+  {
+    NthFieldSink sink = {&field, idx, 0};
+    tokenizeImpl (s, len, delims, keepEmpty, sink);
+    return sink.nbFields > idx;
+  }
+
+/** \brief Fill a vector with the tokens of a line.
+ *  \note Re-using the same vector from one line to the next avoids any
+ *  allocation once its capacity is large enough.
+ */
+  size_t
+  tokenize (
+    const char * s,
+    const size_t & len,
+    const DelimSet & delims,
+    vector<Field> & fields,
+    const bool & keepEmpty)
+  {
+    fields.clear ();
+    VectorFieldSink sink = {&fields};
+    tokenizeImpl (s, len, delims, keepEmpty, sink);
+    return fields.size();
+  }
+
+  size_t
+  tokenize (
+    const string & s,
+    const DelimSet & delims,
+    vector<Field> & fields,
+    const bool & keepEmpty)
+  {
+    return tokenize (s.data(), s.size(), delims, fields, keepEmpty);
+  }
+
 /** \brief Split a string with one delimiter.
- *  \note http://stackoverflow.com/questions/236129/how-to-split-a-string-in-c/236803#236803
+ *  \note Empty tokens are kept, as with std::getline.
  */
   vector<string> &
   split (
@@ -54,12 +274,11 @@ namespace utils {
     char delim,
     vector<string> & tokens)
   {
+    vector<Field> fields;
+    tokenize (s, DelimSet(delim), fields, true);
     tokens.clear();
-    stringstream ss(s);
-    string item;
-    while(getline(ss, item, delim)) {
-      tokens.push_back(item);
-    }
+    for (size_t i = 0; i < fields.size(); ++i)
+      tokens.push_back (s.substr (fields[i].off, fields[i].len));
     return tokens;
   }
 
@@ -75,6 +294,8 @@ namespace utils {
   }
 
 /** \brief Split a string with several delimiters.
+ *  \note Runs of delimiters are collapsed, as with strtok, but the string
+ *  isn't modified.
  */
   vector<string> &
   split (
@@ -82,14 +303,11 @@ namespace utils {
     const char * delim,
     vector<string> & tokens)
   {
+    vector<Field> fields;
+    tokenize (s, DelimSet(delim), fields);
     tokens.clear();
-    char * pch;
-    pch = strtok ((char *) s.c_str(), delim);
-    while (pch != NULL)
-    {
-      tokens.push_back (string(pch));
-      pch = strtok (NULL, delim);
-    }
+    for (size_t i = 0; i < fields.size(); ++i)
+      tokens.push_back (s.substr (fields[i].off, fields[i].len));
     return tokens;
   }
 
@@ -101,14 +319,7 @@ namespace utils {
     const char * delim)
   {
     vector<string> tokens;
-    char * pch;
-    pch = strtok ((char *) s.c_str(), delim);
-    while (pch != NULL)
-    {
-      tokens.push_back (string(pch));
-      pch = strtok (NULL, delim);
-    }
-    return tokens;
+    return split (s, delim, tokens);
   }
 
 /** \brief Split a string with several delimiters and return only the content
@@ -129,6 +340,295 @@ namespace utils {
     return (tokens[idx]);
   }
 
+  static inline bool
+  isDigit (
+    const char & c)
+  {
+    return (unsigned) (c - '0') <= 9;
+  }
+
+/** \brief Parse a non-negative integer written in base 10, which must span
+ *  the whole range.
+ *  \return false if the range is empty, has any other character or overflows
+ */
+  bool
+  parseSize (
+    const char * s,
+    const size_t & len,
+    size_t & val)
+  {
+    if (len == 0)
+      return false;
+    size_t v = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+      if (! isDigit (s[i]) || v > ((size_t) -1 - (s[i] - '0')) / 10)
+	return false;
+      v = v * 10 + (s[i] - '0');
+    }
+    val = v;
+    return true;
+  }
+
+  static const double POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+/** \brief Parse a field of at most 8 characters made only of digits around
+ *  one dot, such as "0.998", reading all digits at once in a 64-bit word.
+ *  \return false if the field doesn't have this form
+ *  \note Below 10^7, the digits and the power of ten are both exact, so
+ *  that the division rounds as strtod does.
+ */
+  static inline bool
+  parseFixedPoint (
+    const char * s,
+    const size_t & len,
+    double & val)
+  {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    const uint64_t ones = 0x0101010101010101ULL, highs = 0x8080808080808080ULL,
+      zeros = 0x3030303030303030ULL;
+    if (len < 2 || len > 8)
+      return false;
+    uint64_t w = 0;
+    memcpy (&w, s, len);
+    uint64_t dots = w ^ (0x2e * ones);
+    dots = (dots - ones) & ~dots & highs;
+    if (dots == 0)
+      return false;
+    unsigned dot = (uint32_t) dots != 0 ? lowestBit ((uint32_t) dots) / 8
+      : 4 + lowestBit ((uint32_t) (dots >> 32)) / 8;
+    if (dot >= len)
+      return false;
+
+    // remove the dot, then left-pad with '0' to have 8 digits, the first
+    // one being in the low byte
+    size_t nbDigits = len - 1;
+    uint64_t low = dot == 0 ? 0 : w & (~0ULL >> (64 - 8 * dot));
+    uint64_t high = dot == 7 ? 0 : w >> (8 * (dot + 1));
+    uint64_t digits = low | (high << (8 * dot));
+    digits = (digits << (8 * (8 - nbDigits))) | (zeros >> (8 * nbDigits));
+    if ((((digits + 0x4646464646464646ULL) | (digits - zeros)) & highs) != 0)
+      return false;
+
+    // http://lemire.me/blog/2022/01/21/swar-explained-parsing-eight-digits/
+    digits -= zeros;
+    digits = (digits * 10) + (digits >> 8);
+    digits = (((digits & 0x000000FF000000FFULL) * 0x000F424000000064ULL)
+	      + (((digits >> 16) & 0x000000FF000000FFULL)
+		 * 0x0000271000000001ULL)) >> 32;
+    val = (double) (uint32_t) digits / POWERS_OF_TEN[nbDigits - dot];
+    return true;
+#else
+    return false;
+#endif
+  }
+
+/** \brief Parse a floating-point number, which must span the whole range,
+ *  without depending on the locale and without copying it.
+ *  \return false if the range isn't a number
+ *  \note Fields like "0.998" are read with parseFixedPoint. Other fields
+ *  whose significand fits in 53 bits and whose exponent is at most 22 in
+ *  absolute value are exact with one multiplication or division (Clinger's
+ *  fast path). The rest is copied on the stack and given to strtod.
+ */
+  bool
+  parseDouble (
+    const char * s,
+    const size_t & len,
+    double & val)
+  {
+    if (parseFixedPoint (s, len, val))
+      return true;
+
+    size_t i = 0;
+    bool negative = false;
+    if (i < len && (s[i] == '-' || s[i] == '+'))
+      negative = (s[i++] == '-');
+    uint64_t mantissa = 0;
+    int exponent = 0, nbDigits = 0, nbSignificant = 0;
+    for (; i < len && isDigit (s[i]); ++i, ++nbDigits)
+      if (nbSignificant < 19)
+      {
+	mantissa = mantissa * 10 + (s[i] - '0');
+	if (mantissa != 0)
+	  ++nbSignificant;
+      }
+      else
+	++exponent;
+    if (i < len && s[i] == '.')
+      for (++i; i < len && isDigit (s[i]); ++i, ++nbDigits)
+	if (nbSignificant < 19)
+	{
+	  mantissa = mantissa * 10 + (s[i] - '0');
+	  if (mantissa != 0)
+	    ++nbSignificant;
+	  --exponent;
+	}
+    bool isSimple = (nbDigits > 0 && nbSignificant < 19);
+    if (isSimple && i < len && (s[i] == 'e' || s[i] == 'E'))
+    {
+      ++i;
+      bool negativeExp = false;
+      if (i < len && (s[i] == '-' || s[i] == '+'))
+	negativeExp = (s[i++] == '-');
+      int e = 0;
+      size_t start = i;
+      for (; i < len && isDigit (s[i]) && e < 10000; ++i)
+	e = e * 10 + (s[i] - '0');
+      isSimple = (i > start);
+      exponent += negativeExp ? -e : e;
+    }
+    if (isSimple && i == len && mantissa <= (1ULL << 53)
+	&& exponent >= -22 && exponent <= 22)
+    {
+      val = (double) mantissa;
+      if (exponent < 0)
+	val /= POWERS_OF_TEN[-exponent];
+      else
+	val *= POWERS_OF_TEN[exponent];
+      if (negative)
+	val = -val;
+      return true;
+    }
+
+    // long significands, large exponents, inf and nan
+    if (len == 0 || isspace ((unsigned char) s[0]))
+      return false;
+    char stackBuf[64];
+    string heapBuf;
+    const char * buf = stackBuf;
+    if (len < sizeof(stackBuf))
+    {
+      memcpy (stackBuf, s, len);
+      stackBuf[len] = '\0';
+    }
+    else
+    {
+      heapBuf.assign (s, len);
+      buf = heapBuf.c_str();
+    }
+    char * end;
+    double v = strtod (buf, &end);
+    if (end != buf + len)
+      return false;
+    val = v;
+    return true;
+  }
+
+/** \brief Write a number in at most FORMAT_DOUBLE_SIZE characters, without
+ *  the trailing '\0', as "%.<precision>g" does, or with the fewest of 15,
+ *  16 or 17 significant digits reading back the same number if precision
+ *  is 0, which is the shortest representation of any normal number.
+ *  Precisions above 17 are taken as 17, which is enough for any double.
+ *  \return the number of characters written
+ *  \note When printf would use the fixed notation with at most 15 digits,
+ *  the number is scaled by an exact power of ten and rounded as an integer,
+ *  which is exact unless it is within a few ulps of a tie. The other cases,
+ *  and the ties, are given to snprintf.
+ */
+  size_t
+  formatDouble (
+    char * buf,
+    const double & x,
+    const int & precision)
+  {
+    if (precision <= 0)
+    {
+      double back;
+      for (int p = 15; p < 17; ++p)
+      {
+	size_t len = formatDouble (buf, x, p);
+	if (parseDouble (buf, len, back) && back == x)
+	  return len;
+      }
+      return formatDouble (buf, x, 17);
+    }
+
+    const int p = min (precision, 17);
+    double ax = fabs (x);
+    if (x == 0)
+    {
+      size_t len = 0;
+      if (signbit (x))
+	buf[len++] = '-';
+      buf[len++] = '0';
+      return len;
+    }
+    if (p <= 15 && ax >= 1e-4 && ax < 1e15)
+    {
+      // find the exponent e such that ax * 10^(p-1-e) is in [10^(p-1), 10^p)
+      int e = 0;
+      if (ax >= 1)
+	while (ax >= POWERS_OF_TEN[e+1])
+	  ++e;
+      else
+	while (e > -5 && ax * POWERS_OF_TEN[-e] < 1)
+	  --e;
+      double y = 0;
+      bool isScaled = false;
+      for (int i = 0; i < 3 && ! isScaled; ++i)
+      {
+	int k = p - 1 - e;
+	if (k < -22 || k > 22)
+	  break;
+	y = (k >= 0 ? ax * POWERS_OF_TEN[k] : ax / POWERS_OF_TEN[-k]);
+	if (y < POWERS_OF_TEN[p-1])
+	  --e;
+	else if (y >= POWERS_OF_TEN[p])
+	  ++e;
+	else
+	  isScaled = true;
+      }
+      double integer = floor (y), frac = y - integer;
+      if (isScaled && fabs (frac - 0.5) > y * 8.8817841970012523e-16) // 2^-50
+      {
+	uint64_t digits = (uint64_t) integer + (frac > 0.5 ? 1 : 0);
+	if (digits == (uint64_t) POWERS_OF_TEN[p])
+	{
+	  digits /= 10;
+	  ++e;
+	}
+	if (e >= -4 && e < p)
+	{
+	  char tmp[16];
+	  int nbDigits = p;
+	  for (int i = p - 1; i >= 0; --i, digits /= 10)
+	    tmp[i] = '0' + (char) (digits % 10);
+	  while (nbDigits > 1 && nbDigits > e + 1 && tmp[nbDigits-1] == '0')
+	    --nbDigits; // as %g, without the trailing zeros of the fraction
+	  size_t len = 0;
+	  if (x < 0)
+	    buf[len++] = '-';
+	  if (e < 0)
+	  {
+	    buf[len++] = '0';
+	    buf[len++] = '.';
+	    for (int i = -1; i > e; --i)
+	      buf[len++] = '0';
+	    memcpy (buf + len, tmp, nbDigits);
+	    len += nbDigits;
+	  }
+	  else
+	  {
+	    memcpy (buf + len, tmp, e + 1);
+	    len += e + 1;
+	    if (nbDigits > e + 1)
+	    {
+	      buf[len++] = '.';
+	      memcpy (buf + len, tmp + e + 1, nbDigits - e - 1);
+	      len += nbDigits - e - 1;
+	    }
+	  }
+	  return len;
+	}
+      }
+    }
+    return snprintf (buf, FORMAT_DOUBLE_SIZE, "%.*g", p, x);
+  }
+
 /** \brief Return the processor time in seconds consumed by the program
  *  since 'startTime'.
  */
@@ -272,68 +772,45 @@ namespace utils {
     }
   }
 
+/** \brief Read one line from a gzFile, without its trailing '\n'.
+ *  \note Kept for callers holding a raw gzFile; prefer LineReader, which
+ *  doesn't copy each line.
+ */
   int
   getline (
     gzFile & fileStream,
     string & line)
   {
-    int res = 1, c;
+    char buf[4096];
     line.clear ();
-    while (true)
+    while (gzgets (fileStream, buf, sizeof(buf)) != NULL)
     {
-      c = gzgetc (fileStream);
-      if (c == -1) // eof or error
+      size_t len = strlen (buf);
+      if (len > 0 && buf[len-1] == '\n')
       {
-	res = 0;
-	break;
+	line.append (buf, len - 1);
+	return 1;
       }
-      else if (c == 10) // 10 is ASCII code for '\n'
-	break;
-      else
-	line.push_back (c);
+      line.append (buf, len);
     }
-    return res;
+    return 0;
   }
 
 /** \brief Read the whole file in a vector of lines
- *  \note could be speed-up by reading blocks rather than lines
  */
   int
   readFile (
     const string & pathToFile,
     vector<string> & lines)
   {
-    gzFile stream;
-    string line;
-    size_t line_id = 0; //, nb_lines = 0;
-    
-    openFile(pathToFile, stream, "rb");
-    
-    // while(getline(stream, line))
-    //   ++nb_lines;
+    LineReader reader (pathToFile);
+    const char * line;
+    size_t len;
     
-    // if(! gzeof(stream)){
-    //   cerr << "ERROR: can't read successfully file "
-    // 	   << pathToFile << " up to the end" << endl;
-    //   exit (1);
-    // }
-    
-    // lines.reserve(nb_lines);
-    
-    // gzrewind(stream); // go back to beginning of file
-    
-    while(getline(stream, line)){
-      lines.push_back(line);
-      ++line_id;
-    }
-    
-    if(! gzeof(stream)){
-      cerr << "ERROR: can't read successfully file "
-	   << pathToFile << " up to the end" << endl;
-      exit (1);
-    }
+    while(reader.getline(line, len))
+      lines.push_back(string(line, len));
     
-    closeFile(pathToFile, stream);
+    reader.close();
     
     return 0;
   }
@@ -354,6 +831,3442 @@ namespace utils {
     }
   }
 
+  ThreadPool::ThreadPool (
+    const size_t & nbThreads)
+    : stop_(false)
+  {
+    for (size_t i = 0; i < nbThreads; ++i)
+      threads_.push_back (thread (&ThreadPool::work, this));
+  }
+
+  ThreadPool::~ThreadPool (void)
+  {
+    {
+      lock_guard<mutex> lock (mutex_);
+      stop_ = true;
+    }
+    cond_.notify_all ();
+    for (size_t i = 0; i < threads_.size(); ++i)
+      threads_[i].join ();
+  }
+
+  void
+  ThreadPool::submit (
+    const function<void(void)> & task)
+  {
+    {
+      lock_guard<mutex> lock (mutex_);
+      tasks_.push_back (task);
+    }
+    cond_.notify_one ();
+  }
+
+  void
+  ThreadPool::work (void)
+  {
+    while (true)
+    {
+      function<void(void)> task;
+      {
+	unique_lock<mutex> lock (mutex_);
+	while (! stop_ && tasks_.empty())
+	  cond_.wait (lock);
+	if (tasks_.empty()) // stop_ is true
+	  return;
+	task = tasks_.front ();
+	tasks_.pop_front ();
+      }
+      task ();
+    }
+  }
+
+  const size_t PrefetchSource::DEFAULT_BLOCK_SIZE;
+  const size_t PrefetchSource::DEFAULT_NB_BLOCKS;
+
+  PrefetchSource::PrefetchSource (
+    const string & pathToFile,
+    const size_t & blockSize,
+    const size_t & nbBlocks,
+    const uint64_t & offset)
+    : path_(pathToFile), fd_(-1), blockSize_(blockSize), pos_(0),
+      end_(false), blocks_(max (nbBlocks, (size_t) 1)), head_(0), tail_(0),
+      stop_(false), consumerWaits_(false), producerWaits_(false)
+  {
+    fd_ = ::open (path_.c_str(), O_RDONLY);
+    if (fd_ < 0 || (offset > 0
+		    && lseek (fd_, (off_t) offset, SEEK_SET) == (off_t) -1))
+    {
+      cerr << "ERROR: can't open file " << path_ << " to read"
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise (fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    for (size_t i = 0; i < blocks_.size(); ++i)
+    {
+      blocks_[i].data = (char *) malloc (blockSize_);
+      if (blocks_[i].data == NULL)
+      {
+	cerr << "ERROR: can't allocate " << blockSize_ << " bytes to read file "
+	     << path_ << endl;
+	exit (1);
+      }
+    }
+    thread_ = thread (&PrefetchSource::produce, this);
+  }
+
+  PrefetchSource::~PrefetchSource (void)
+  {
+    close ();
+    for (size_t i = 0; i < blocks_.size(); ++i)
+      free (blocks_[i].data);
+  }
+
+/** \brief Block until isReady() is true.
+ *  \note The other thread takes the lock to wake this one only if it sees
+ *  isWaiting set, and both flags and positions are sequentially
+ *  consistent, so that either it sees the flag or isReady() sees its move.
+ */
+  void
+  PrefetchSource::sleepUntil (
+    atomic<bool> & isWaiting,
+    const function<bool(void)> & isReady)
+  {
+    unique_lock<mutex> lock (mutex_);
+    isWaiting = true;
+    while (! isReady())
+      cond_.wait (lock);
+    isWaiting = false;
+  }
+
+  void
+  PrefetchSource::wake (
+    atomic<bool> & isWaiting)
+  {
+    if (isWaiting)
+    {
+      lock_guard<mutex> lock (mutex_);
+      cond_.notify_all ();
+    }
+  }
+
+/** \brief Fill the free blocks of the ring, in the order of the file,
+ *  until the end of the file or an error, which ends the last block.
+ */
+  void
+  PrefetchSource::produce (void)
+  {
+    size_t nbBlocks = blocks_.size();
+    off_t offset = lseek (fd_, 0, SEEK_CUR);
+    for (size_t n = 0; ; ++n)
+    {
+      if (n - head_ == nbBlocks)
+	sleepUntil (producerWaits_, [&]{ return stop_ || n - head_ < nbBlocks; });
+      if (stop_)
+	return;
+
+      Block & block = blocks_[n % nbBlocks];
+      block.len = 0;
+      block.errnum = 0;
+      while (block.len < blockSize_)
+      {
+	ssize_t nbRead = ::read (fd_, block.data + block.len,
+				 blockSize_ - block.len);
+	if (nbRead < 0 && errno == EINTR)
+	  continue;
+	if (nbRead < 0)
+	  block.errnum = errno;
+	if (nbRead <= 0)
+	  break;
+	block.len += nbRead;
+      }
+      offset += block.len;
+#ifdef POSIX_FADV_WILLNEED
+      posix_fadvise (fd_, offset, (off_t) (nbBlocks * blockSize_),
+		     POSIX_FADV_WILLNEED);
+#endif
+
+      tail_ = n + 1;
+      wake (consumerWaits_);
+      if (block.len < blockSize_)
+	return;
+    }
+  }
+
+/** \brief Copy bytes from the ring, waiting for the producer only if none
+ *  is available yet.
+ */
+  size_t
+  PrefetchSource::read (
+    char * buf,
+    const size_t & len)
+  {
+    size_t nbRead = 0;
+    while (nbRead < len && ! end_)
+    {
+      size_t head = head_;
+      if (head == tail_)
+      {
+	if (nbRead > 0)
+	  break;
+	sleepUntil (consumerWaits_, [&]{ return head != tail_; });
+      }
+
+      const Block & block = blocks_[head % blocks_.size()];
+      if (block.errnum != 0)
+      {
+	cerr << "ERROR: can't read file " << path_
+	     << " (errno=" << block.errnum << ")" << endl;
+	exit (1);
+      }
+      size_t n = min (len - nbRead, block.len - pos_);
+      memcpy (buf + nbRead, block.data + pos_, n);
+      pos_ += n;
+      nbRead += n;
+      if (pos_ == block.len)
+      {
+	end_ = (block.len < blockSize_);
+	pos_ = 0;
+	head_ = head + 1;
+	wake (producerWaits_);
+      }
+    }
+    return nbRead;
+  }
+
+  void
+  PrefetchSource::close (void)
+  {
+    if (thread_.joinable())
+    {
+      stop_ = true;
+      {
+	lock_guard<mutex> lock (mutex_);
+	cond_.notify_all ();
+      }
+      thread_.join ();
+    }
+    if (fd_ >= 0)
+    {
+      ::close (fd_);
+      fd_ = -1;
+    }
+  }
+
+  GzSource::GzSource (
+    const string & pathToFile)
+    : path_(pathToFile), raw_(pathToFile), in_(128 * 1024), mode_(UNKNOWN),
+      isRaw_(false)
+  {
+    memset (&strm_, 0, sizeof(strm_));
+    strm_.next_in = &in_[0];
+  }
+
+/** \brief Inflate a gzip file from one of the checkpoints of its index.
+ */
+  GzSource::GzSource (
+    const string & pathToFile,
+    const GzIndex::Checkpoint & start)
+    : path_(pathToFile),
+      raw_(pathToFile, PrefetchSource::DEFAULT_BLOCK_SIZE,
+	   PrefetchSource::DEFAULT_NB_BLOCKS,
+	   start.in - (start.bits > 0 ? 1 : 0)),
+      in_(128 * 1024), mode_(GZIP), isRaw_(! start.isMember)
+  {
+    memset (&strm_, 0, sizeof(strm_));
+    strm_.next_in = &in_[0];
+    int ret = inflateInit2 (&strm_, isRaw_ ? -15 : 15 + 16);
+    if (ret == Z_OK && start.bits > 0)
+    {
+      if (fillInput (1) == 0)
+	ret = Z_DATA_ERROR;
+      else
+      {
+	ret = inflatePrime (&strm_, start.bits,
+			    strm_.next_in[0] >> (8 - start.bits));
+	++strm_.next_in;
+	--strm_.avail_in;
+      }
+    }
+    if (ret == Z_OK && isRaw_ && ! start.window.empty())
+      ret = inflateSetDictionary (&strm_, &start.window[0],
+				  start.window.size());
+    if (ret != Z_OK)
+    {
+      cerr << "ERROR: can't start inflating file " << path_ << " at offset "
+	   << start.in << endl;
+      exit (1);
+    }
+  }
+
+  GzSource::~GzSource (void)
+  {
+    close ();
+  }
+
+/** \brief Move the unread input at the front, and append bytes after it
+ *  until there are at least minLen or the file ends.
+ *  \return number of unread bytes
+ */
+  size_t
+  GzSource::fillInput (
+    const size_t & minLen)
+  {
+    if (strm_.avail_in >= minLen)
+      return strm_.avail_in;
+    memmove (&in_[0], strm_.next_in, strm_.avail_in);
+    strm_.next_in = &in_[0];
+    while (strm_.avail_in < minLen)
+    {
+      size_t nbRead = raw_.read ((char *) &in_[strm_.avail_in],
+				 in_.size() - strm_.avail_in);
+      if (nbRead == 0)
+	break;
+      strm_.avail_in += nbRead;
+    }
+    return strm_.avail_in;
+  }
+
+  bool
+  GzSource::startsMember (void) const
+  {
+    return strm_.avail_in >= 2 && strm_.next_in[0] == 31
+      && strm_.next_in[1] == 139;
+  }
+
+  size_t
+  GzSource::read (
+    char * buf,
+    const size_t & len)
+  {
+    if (mode_ == UNKNOWN)
+    {
+      fillInput (2);
+      mode_ = startsMember() ? GZIP : PLAIN;
+      if (mode_ == GZIP && inflateInit2 (&strm_, 15 + 16) != Z_OK)
+      {
+	cerr << "ERROR: can't initialize zlib to read file " << path_ << endl;
+	exit (1);
+      }
+    }
+
+    if (mode_ == PLAIN)
+    {
+      if (strm_.avail_in == 0)
+	return raw_.read (buf, len);
+      size_t n = min (len, (size_t) strm_.avail_in);
+      memcpy (buf, strm_.next_in, n);
+      strm_.next_in += n;
+      strm_.avail_in -= n;
+      return n;
+    }
+
+    strm_.next_out = (Bytef *) buf;
+    strm_.avail_out = (uInt) min (len, (size_t) (1U << 30));
+    uInt outLen = strm_.avail_out;
+    while (mode_ == GZIP && strm_.avail_out == outLen)
+    {
+      if (fillInput (1) == 0)
+      {
+	cerr << "ERROR: can't read file " << path_
+	     << " (unexpected end of file)" << endl;
+	exit (1);
+      }
+      int ret = inflate (&strm_, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END)
+      {
+	if (isRaw_) // skip the gzip trailer, which wasn't inflated
+	{
+	  size_t n = min ((size_t) 8, fillInput (8));
+	  strm_.next_in += n;
+	  strm_.avail_in -= n;
+	}
+	// as gzread, go on with the next member, but ignore trailing garbage
+	fillInput (2);
+	if (startsMember())
+	{
+	  inflateReset2 (&strm_, 15 + 16);
+	  isRaw_ = false;
+	}
+	else
+	  mode_ = END;
+      }
+      else if (ret != Z_OK)
+      {
+	cerr << "ERROR: can't read file " << path_ << " ("
+	     << (strm_.msg != NULL ? strm_.msg : "invalid data") << ")" << endl;
+	exit (1);
+      }
+    }
+    return outLen - strm_.avail_out;
+  }
+
+  void
+  GzSource::close (void)
+  {
+    if (strm_.state != Z_NULL)
+      inflateEnd (&strm_);
+    mode_ = END;
+    strm_.avail_in = 0;
+    raw_.close ();
+  }
+
+/** \brief Return the value of a little-endian integer of n bytes.
+ */
+  static inline uint64_t
+  readLittleEndian (
+    const unsigned char * p,
+    const size_t & n)
+  {
+    uint64_t v = 0;
+    for (size_t i = n; i > 0; --i)
+      v = (v << 8) | p[i-1];
+    return v;
+  }
+
+  const size_t GzIndex::DEFAULT_SPACING;
+
+  static const size_t GZ_WINDOW_SIZE = 32768;
+
+  static const char GZ_INDEX_MAGIC[8] = {'G', 'Z', 'I', 'D', 'X', 1, 0, 0};
+
+/** \brief Write an unsigned integer on n bytes, in little-endian.
+ */
+  static void
+  writeLittleEndian (
+    vector<unsigned char> & buf,
+    const uint64_t & v,
+    const size_t & n)
+  {
+    for (size_t i = 0; i < n; ++i)
+      buf.push_back ((unsigned char) (v >> (8 * i)));
+  }
+
+/** \brief Return the size and modification time of a file, to check that
+ *  its index is up to date.
+ */
+  static void
+  getFileStamp (
+    const string & pathToFile,
+    uint64_t & size,
+    uint64_t & time)
+  {
+    struct stat st;
+    if (stat (pathToFile.c_str(), &st) != 0)
+    {
+      cerr << "ERROR: can't open file " << pathToFile << " to read"
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+    size = st.st_size;
+    time = st.st_mtime;
+  }
+
+  GzIndex::GzIndex (void)
+  {
+    clear ();
+  }
+
+  void
+  GzIndex::clear (void)
+  {
+    path_.clear ();
+    fileSize_ = fileTime_ = inflatedSize_ = nbLines_ = 0;
+    checkpoints_.clear ();
+  }
+
+/** \brief Load the index of a gzip file, or build it and save it next to
+ *  the file if it doesn't exist yet or is older than the file.
+ */
+  void
+  GzIndex::open (
+    const string & pathToFile,
+    const size_t & spacing)
+  {
+    if (load (pathToFile))
+      return;
+    build (pathToFile, spacing);
+    save ();
+  }
+
+/** \brief Inflate the whole file once, keeping a checkpoint at the first
+ *  gzip member or deflate block starting at least 'spacing' bytes after
+ *  the previous checkpoint.
+ */
+  void
+  GzIndex::build (
+    const string & pathToFile,
+    const size_t & spacing)
+  {
+    clear ();
+    path_ = pathToFile;
+    getFileStamp (path_, fileSize_, fileTime_);
+
+    PrefetchSource src (path_);
+    vector<unsigned char> in (1 << 16), out (GZ_WINDOW_SIZE);
+    z_stream strm;
+    memset (&strm, 0, sizeof(strm));
+    strm.next_in = &in[0];
+    if (inflateInit2 (&strm, 15 + 16) != Z_OK)
+    {
+      cerr << "ERROR: can't initialize zlib to read file " << path_ << endl;
+      exit (1);
+    }
+    uint64_t totalIn = 0; // the window is out, as a ring starting at outPos
+    size_t outPos = 0;
+    bool isMemberStart = true, isLineStart = true, isFileEnd = false;
+    Checkpoint cp;
+    while (true)
+    {
+      if (strm.avail_in < 2 && ! isFileEnd)
+      {
+	memmove (&in[0], strm.next_in, strm.avail_in);
+	strm.next_in = &in[0];
+	size_t nbRead = src.read ((char *) &in[strm.avail_in],
+				  in.size() - strm.avail_in);
+	strm.avail_in += nbRead;
+	isFileEnd = (nbRead == 0);
+      }
+      if (isMemberStart)
+      {
+	// as gzread, ignore trailing garbage
+	if (strm.avail_in < 2 || strm.next_in[0] != 31
+	    || strm.next_in[1] != 139)
+	  break;
+	if (checkpoints_.empty()
+	    || inflatedSize_ - checkpoints_.back().out >= spacing)
+	{
+	  cp.in = totalIn;
+	  cp.out = inflatedSize_;
+	  cp.line = nbLines_;
+	  cp.bits = 0;
+	  cp.isMember = true;
+	  cp.isLineStart = isLineStart;
+	  checkpoints_.push_back (cp);
+	}
+	isMemberStart = false;
+      }
+      if (strm.avail_in == 0)
+      {
+	cerr << "ERROR: can't read file " << path_
+	     << " (unexpected end of file)" << endl;
+	exit (1);
+      }
+
+      strm.next_out = &out[outPos];
+      strm.avail_out = GZ_WINDOW_SIZE - outPos;
+      uInt availIn = strm.avail_in;
+      int ret = inflate (&strm, Z_BLOCK);
+      size_t nbOut = GZ_WINDOW_SIZE - outPos - strm.avail_out;
+      for (const unsigned char * p = &out[outPos];
+	   (p = (const unsigned char *) memchr (p, '\n', &out[outPos] + nbOut - p))
+	     != NULL; ++p)
+	++nbLines_;
+      if (nbOut > 0)
+	isLineStart = (out[outPos + nbOut - 1] == '\n');
+      outPos = (outPos + nbOut) % GZ_WINDOW_SIZE;
+      inflatedSize_ += nbOut;
+      totalIn += availIn - strm.avail_in;
+
+      if (ret == Z_STREAM_END)
+      {
+	inflateReset (&strm);
+	isMemberStart = true;
+	continue;
+      }
+      if (ret != Z_OK)
+      {
+	cerr << "ERROR: can't read file " << path_ << " ("
+	     << (strm.msg != NULL ? strm.msg : "invalid data") << ")" << endl;
+	exit (1);
+      }
+      // at the end of a deflate block which isn't the last one
+      if ((strm.data_type & 128) && ! (strm.data_type & 64)
+	  && inflatedSize_ - checkpoints_.back().out >= spacing)
+      {
+	cp.in = totalIn;
+	cp.out = inflatedSize_;
+	cp.line = nbLines_;
+	cp.bits = strm.data_type & 7;
+	cp.isMember = false;
+	cp.isLineStart = isLineStart;
+	checkpoints_.push_back (cp);
+	vector<unsigned char> & window = checkpoints_.back().window;
+	if (inflatedSize_ >= GZ_WINDOW_SIZE)
+	{
+	  window.assign (out.begin() + outPos, out.end());
+	  window.insert (window.end(), out.begin(), out.begin() + outPos);
+	}
+	else
+	  window.assign (out.begin(), out.begin() + outPos);
+      }
+    }
+    inflateEnd (&strm);
+    src.close ();
+    if (checkpoints_.empty())
+    {
+      cerr << "ERROR: can't index file " << path_ << ", which isn't gzipped"
+	   << endl;
+      exit (1);
+    }
+    if (! isLineStart)
+      ++nbLines_; // last line without '\n'
+  }
+
+/** \brief Load the index saved next to a gzip file.
+ *  \return false if there is none, or if it is older than the file
+ */
+  bool
+  GzIndex::load (
+    const string & pathToFile)
+  {
+    clear ();
+    uint64_t fileSize, fileTime;
+    getFileStamp (pathToFile, fileSize, fileTime);
+    string pathToIndex = getPath (pathToFile);
+    FILE * file = fopen (pathToIndex.c_str(), "rb");
+    if (file == NULL)
+      return false;
+
+    unsigned char header[48], entry[32];
+    vector<unsigned char> window;
+    bool isValid = fread (header, 1, 48, file) == 48
+      && memcmp (header, GZ_INDEX_MAGIC, 8) == 0
+      && readLittleEndian (header + 8, 8) == fileSize
+      && readLittleEndian (header + 16, 8) == fileTime
+      && readLittleEndian (header + 40, 8) <= fileSize;
+    if (isValid)
+    {
+      path_ = pathToFile;
+      fileSize_ = fileSize;
+      fileTime_ = fileTime;
+      inflatedSize_ = readLittleEndian (header + 24, 8);
+      nbLines_ = readLittleEndian (header + 32, 8);
+      checkpoints_.resize (readLittleEndian (header + 40, 8));
+    }
+    for (size_t i = 0; isValid && i < checkpoints_.size(); ++i)
+    {
+      Checkpoint & cp = checkpoints_[i];
+      isValid = fread (entry, 1, 32, file) == 32;
+      cp.in = readLittleEndian (entry, 8);
+      cp.out = readLittleEndian (entry + 8, 8);
+      cp.line = readLittleEndian (entry + 16, 8);
+      cp.bits = entry[24] & 7;
+      cp.isMember = entry[25] & 1;
+      cp.isLineStart = (entry[25] >> 1) & 1;
+      cp.window.resize (readLittleEndian (entry + 26, 2));
+      window.resize (readLittleEndian (entry + 28, 4));
+      if (isValid && ! cp.window.empty())
+      {
+	uLongf windowLen = cp.window.size();
+	isValid = window.size() <= compressBound (GZ_WINDOW_SIZE)
+	  && fread (&window[0], 1, window.size(), file) == window.size()
+	  && uncompress (&cp.window[0], &windowLen, &window[0], window.size())
+	  == Z_OK && windowLen == cp.window.size();
+      }
+    }
+    fclose (file);
+    if (! isValid || checkpoints_.empty())
+    {
+      clear ();
+      return false;
+    }
+    return true;
+  }
+
+/** \brief Save the index next to its gzip file, as <file>.gzidx, with
+ *  the windows compressed.
+ *  \note An index which can't be written is only reported, as it can
+ *  still be used, and be built again next time.
+ */
+  void
+  GzIndex::save (void) const
+  {
+    vector<unsigned char> window (compressBound (GZ_WINDOW_SIZE));
+    vector<unsigned char> buf (GZ_INDEX_MAGIC, GZ_INDEX_MAGIC + 8);
+    writeLittleEndian (buf, fileSize_, 8);
+    writeLittleEndian (buf, fileTime_, 8);
+    writeLittleEndian (buf, inflatedSize_, 8);
+    writeLittleEndian (buf, nbLines_, 8);
+    writeLittleEndian (buf, checkpoints_.size(), 8);
+    for (size_t i = 0; i < checkpoints_.size(); ++i)
+    {
+      const Checkpoint & cp = checkpoints_[i];
+      writeLittleEndian (buf, cp.in, 8);
+      writeLittleEndian (buf, cp.out, 8);
+      writeLittleEndian (buf, cp.line, 8);
+      writeLittleEndian (buf, cp.bits, 1);
+      writeLittleEndian (buf, (cp.isMember ? 1 : 0) | (cp.isLineStart ? 2 : 0),
+			 1);
+      uLongf windowLen = 0;
+      if (! cp.window.empty())
+      {
+	windowLen = window.size();
+	compress (&window[0], &windowLen, &cp.window[0], cp.window.size());
+      }
+      writeLittleEndian (buf, cp.window.size(), 2);
+      writeLittleEndian (buf, windowLen, 4);
+      buf.insert (buf.end(), window.begin(), window.begin() + windowLen);
+    }
+
+    string pathToIndex = getPath (path_);
+    FILE * file = fopen (pathToIndex.c_str(), "wb");
+    bool isWritten = (file != NULL);
+    if (file != NULL)
+    {
+      isWritten = (fwrite (&buf[0], 1, buf.size(), file) == buf.size());
+      isWritten = (fclose (file) == 0) && isWritten;
+      if (! isWritten)
+	remove (pathToIndex.c_str());
+    }
+    if (! isWritten)
+      cerr << "WARNING: can't write index file " << pathToIndex
+	   << " (errno=" << errno << ")" << endl;
+  }
+
+/** \brief Return the last checkpoint from which reading up to line lineId
+ *  (excluded) doesn't go past it.
+ */
+  const GzIndex::Checkpoint &
+  GzIndex::findLine (
+    const uint64_t & lineId) const
+  {
+    size_t lo = 0, hi = checkpoints_.size();
+    while (hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      const Checkpoint & cp = checkpoints_[mid];
+      if (cp.line + (cp.isLineStart ? 0 : 1) <= lineId)
+	lo = mid;
+      else
+	hi = mid;
+    }
+    return checkpoints_[lo];
+  }
+
+/** \brief Return the last checkpoint at or before an offset of the
+ *  inflated data.
+ */
+  const GzIndex::Checkpoint &
+  GzIndex::findOffset (
+    const uint64_t & offset) const
+  {
+    size_t lo = 0, hi = checkpoints_.size();
+    while (hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (checkpoints_[mid].out <= offset)
+	lo = mid;
+      else
+	hi = mid;
+    }
+    return checkpoints_[lo];
+  }
+
+/** \brief Return the size of the BGZF block whose header is given, or 0 if
+ *  it isn't a BGZF header.
+ *  \note The header must be complete, ie. 12 bytes + XLEN.
+ */
+  static size_t
+  getBgzfBlockSize (
+    const unsigned char * header,
+    const size_t & len)
+  {
+    if (len < 12 || header[0] != 31 || header[1] != 139 || header[2] != 8
+	|| ! (header[3] & 4)) // FEXTRA
+      return 0;
+    size_t xlen = readLittleEndian (header + 10, 2);
+    if (len < 12 + xlen)
+      return 0;
+    const unsigned char * extra = header + 12;
+    for (size_t i = 0; i + 4 <= xlen; )
+    {
+      size_t slen = readLittleEndian (extra + i + 2, 2);
+      if (extra[i] == 'B' && extra[i+1] == 'C' && slen == 2 && i + 6 <= xlen)
+	return readLittleEndian (extra + i + 4, 2) + 1;
+      i += 4 + slen;
+    }
+    return 0;
+  }
+
+/** \brief Append the next BGZF block of a file to a buffer.
+ *  \return the size of the block, 0 at the end of the file
+ */
+  static size_t
+  readBgzfBlock (
+    FILE * file,
+    vector<char> & buf,
+    const string & pathToFile,
+    const uint64_t & offset)
+  {
+    size_t start = buf.size();
+    buf.resize (start + 12);
+    size_t nbRead = fread (&buf[start], 1, 12, file);
+    if (nbRead == 0 && feof (file))
+    {
+      buf.resize (start);
+      return 0;
+    }
+    size_t xlen = (nbRead == 12) ?
+      readLittleEndian ((const unsigned char *) &buf[start] + 10, 2) : 0;
+    buf.resize (start + 12 + xlen);
+    if (nbRead == 12 && xlen > 0)
+      nbRead += fread (&buf[start+12], 1, xlen, file);
+    size_t blockSize = 0;
+    if (nbRead == 12 + xlen)
+      blockSize = getBgzfBlockSize ((const unsigned char *) &buf[start],
+				    12 + xlen);
+    if (blockSize < 12 + xlen + 8)
+    {
+      cerr << "ERROR: file " << pathToFile << " has no valid BGZF header"
+	   << " at byte " << offset << endl;
+      exit (1);
+    }
+    buf.resize (start + blockSize);
+    if (fread (&buf[start+12+xlen], 1, blockSize - 12 - xlen, file)
+	!= blockSize - 12 - xlen)
+    {
+      cerr << "ERROR: file " << pathToFile << " is truncated"
+	   << " in the BGZF block at byte " << offset << endl;
+      exit (1);
+    }
+    return blockSize;
+  }
+
+/** \brief Inflate a whole BGZF block at the end of a buffer, with a raw
+ *  inflate stream re-used from one block to the next.
+ *  \return false if the block is corrupted
+ */
+  static bool
+  inflateBgzfBlock (
+    z_stream & strm,
+    const unsigned char * block,
+    const size_t & blockSize,
+    vector<char> & out)
+  {
+    size_t headerSize = 12 + readLittleEndian (block + 10, 2);
+    uint32_t crc = readLittleEndian (block + blockSize - 8, 4),
+      isize = readLittleEndian (block + blockSize - 4, 4);
+    size_t start = out.size();
+    out.resize (start + isize + 1); // inflate() refuses a null next_out
+    inflateReset (&strm);
+    strm.next_in = (Bytef *) block + headerSize;
+    strm.avail_in = blockSize - headerSize - 8;
+    strm.next_out = (Bytef *) &out[start];
+    strm.avail_out = isize;
+    int ret = inflate (&strm, Z_FINISH);
+    out.resize (start + isize);
+    return ret == Z_STREAM_END && strm.avail_out == 0
+      && crc32 (crc32 (0L, Z_NULL, 0), (const Bytef *) &out[start], isize)
+      == crc;
+  }
+
+/** \brief Return true if the file starts with a BGZF block.
+ */
+  bool
+  isBgzf (
+    const string & pathToFile)
+  {
+    unsigned char header[64];
+    size_t len = 0;
+    FILE * file = fopen (pathToFile.c_str(), "rb");
+    if (file != NULL)
+    {
+      len = fread (header, 1, sizeof(header), file);
+      fclose (file);
+    }
+    if (len < 12)
+      return false;
+    size_t xlen = readLittleEndian (header + 10, 2);
+    return 12 + xlen <= len && getBgzfBlockSize (header, 12 + xlen) > 0;
+  }
+
+/** \brief Compressed BGZF blocks inflated by a thread of the pool.
+ */
+  struct BgzfSource::Job
+  {
+    vector<char> in, out;
+    vector<size_t> blockSizes;
+    uint64_t offset; // of the first block in the compressed file
+    bool done;
+    string error;
+
+    void inflateBlocks (void);
+  };
+
+  void
+  BgzfSource::Job::inflateBlocks (void)
+  {
+    z_stream strm;
+    memset (&strm, 0, sizeof(strm));
+    if (inflateInit2 (&strm, -15) != Z_OK) // raw deflate data
+    {
+      error = "inflateInit2 failed";
+      return;
+    }
+    out.clear ();
+    const unsigned char * block = (const unsigned char *) &in[0];
+    uint64_t blockOffset = offset;
+    for (size_t b = 0; b < blockSizes.size(); ++b)
+    {
+      size_t blockSize = blockSizes[b];
+      if (! inflateBgzfBlock (strm, block, blockSize, out))
+      {
+	stringstream ss;
+	ss << "corrupted BGZF block at byte " << blockOffset;
+	if (strm.msg != NULL)
+	  ss << " (" << strm.msg << ")";
+	error = ss.str();
+	break;
+      }
+      block += blockSize;
+      blockOffset += blockSize;
+    }
+    inflateEnd (&strm);
+  }
+
+  BgzfSource::BgzfSource (
+    const string & pathToFile,
+    const size_t & nbThreads,
+    const uint64_t & offset)
+    : path_(pathToFile), file_(NULL), offset_(offset), fileEnd_(false),
+      maxJobs_(2 * nbThreads + 2), pos_(0), pool_(nbThreads)
+  {
+    file_ = fopen (path_.c_str(), "rb");
+    if (file_ == NULL || (offset_ > 0
+			  && fseeko (file_, (off_t) offset_, SEEK_SET) != 0))
+    {
+      cerr << "ERROR: can't open file " << path_ << " to read"
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+  }
+
+  BgzfSource::~BgzfSource (void)
+  {
+    waitJobs ();
+    for (size_t i = 0; i < jobs_.size(); ++i)
+      delete jobs_[i];
+    for (size_t i = 0; i < freeJobs_.size(); ++i)
+      delete freeJobs_[i];
+    if (file_ != NULL)
+      fclose (file_);
+  }
+
+/** \brief Read the next blocks of the file, and submit them to the pool,
+ *  until enough jobs are in flight.
+ */
+  void
+  BgzfSource::submitJobs (void)
+  {
+    while (! fileEnd_ && jobs_.size() < maxJobs_)
+    {
+      Job * job;
+      if (freeJobs_.empty())
+	job = new Job;
+      else
+      {
+	job = freeJobs_.back ();
+	freeJobs_.pop_back ();
+      }
+      job->in.clear ();
+      job->blockSizes.clear ();
+      job->offset = offset_;
+      job->done = false;
+      job->error.clear ();
+      while (job->in.size() < (512 << 10)) // about 8 blocks
+      {
+	size_t blockSize = readBgzfBlock (file_, job->in, path_, offset_);
+	if (blockSize == 0)
+	{
+	  fileEnd_ = true;
+	  break;
+	}
+	job->blockSizes.push_back (blockSize);
+	offset_ += blockSize;
+      }
+      if (job->blockSizes.empty())
+      {
+	freeJobs_.push_back (job);
+	break;
+      }
+      jobs_.push_back (job);
+      pool_.submit ([this, job] () {
+	  job->inflateBlocks ();
+	  // notify under the lock, as the source may be destroyed as soon as
+	  // its last job is seen done
+	  lock_guard<mutex> lock (mutex_);
+	  job->done = true;
+	  done_.notify_all ();
+	});
+    }
+  }
+
+  void
+  BgzfSource::waitJobs (void)
+  {
+    unique_lock<mutex> lock (mutex_);
+    for (size_t i = 0; i < jobs_.size(); ++i)
+      while (! jobs_[i]->done)
+	done_.wait (lock);
+  }
+
+  size_t
+  BgzfSource::read (
+    char * buf,
+    const size_t & len)
+  {
+    while (true)
+    {
+      submitJobs ();
+      if (jobs_.empty())
+	return 0;
+      Job * job = jobs_.front ();
+      {
+	unique_lock<mutex> lock (mutex_);
+	while (! job->done)
+	  done_.wait (lock);
+      }
+      if (! job->error.empty())
+      {
+	cerr << "ERROR: can't read file " << path_ << ", "
+	     << job->error << endl;
+	exit (1);
+      }
+      if (pos_ < job->out.size())
+      {
+	size_t n = min (len, job->out.size() - pos_);
+	memcpy (buf, &job->out[pos_], n);
+	pos_ += n;
+	return n;
+      }
+      jobs_.pop_front ();
+      freeJobs_.push_back (job);
+      pos_ = 0;
+    }
+  }
+
+  void
+  BgzfSource::close (void)
+  {
+    waitJobs ();
+    if (file_ != NULL)
+    {
+      if (ferror (file_))
+      {
+	cerr << "ERROR: can't read file " << path_ << " (errno="
+	     << errno << ")" << endl;
+	exit (1);
+      }
+      fclose (file_);
+      file_ = NULL;
+    }
+  }
+
+/** \brief Append one BGZF block, with the given data compressed, to a
+ *  buffer.
+ *  \return false if the block couldn't be compressed
+ */
+  static bool
+  deflateBgzfBlock (
+    z_stream & strm,
+    const char * data,
+    const size_t & len,
+    vector<char> & out)
+  {
+    static const unsigned char header[18] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255,
+					     6, 0, 'B', 'C', 2, 0, 0, 0};
+    size_t start = out.size();
+    out.resize (start + 65536);
+    unsigned char * block = (unsigned char *) &out[start];
+    memcpy (block, header, 18);
+    deflateReset (&strm);
+    strm.next_in = (Bytef *) data;
+    strm.avail_in = len;
+    strm.next_out = block + 18;
+    strm.avail_out = 65536 - 18 - 8;
+    if (deflate (&strm, Z_FINISH) != Z_STREAM_END)
+      return false;
+    size_t blockSize = 18 + strm.total_out + 8;
+    uint32_t crc = crc32 (crc32 (0L, Z_NULL, 0), (const Bytef *) data, len);
+    block[16] = (blockSize - 1) & 0xff;
+    block[17] = (blockSize - 1) >> 8;
+    for (int i = 0; i < 4; ++i)
+    {
+      block[blockSize-8+i] = (crc >> (8*i)) & 0xff;
+      block[blockSize-4+i] = ((uint32_t) len >> (8*i)) & 0xff;
+    }
+    out.resize (start + blockSize);
+    return true;
+  }
+
+/** \brief Uncompressed data to be cut into BGZF blocks by a thread of the
+ *  pool.
+ */
+  struct BgzfWriter::Job
+  {
+    vector<char> in, out;
+    size_t firstLine, lastLine;
+    bool done, failed;
+
+    void deflateBlocks (const int & level);
+  };
+
+  void
+  BgzfWriter::Job::deflateBlocks (
+    const int & level)
+  {
+    z_stream strm;
+    memset (&strm, 0, sizeof(strm));
+    failed = (deflateInit2 (&strm, level, Z_DEFLATED, -15, 8,
+			    Z_DEFAULT_STRATEGY) != Z_OK);
+    out.clear ();
+    for (size_t start = 0; ! failed && start < in.size();
+	 start += BgzfWriter::BLOCK_SIZE)
+      failed = ! deflateBgzfBlock (strm, &in[start],
+				   min (BgzfWriter::BLOCK_SIZE,
+					in.size() - start), out);
+    deflateEnd (&strm);
+  }
+
+  const size_t BgzfWriter::BLOCK_SIZE;
+
+  BgzfWriter::BgzfWriter (void)
+    : file_(NULL), level_(Z_DEFAULT_COMPRESSION), nbLines_(0), maxJobs_(0),
+      current_(NULL), pool_(NULL), ownPool_(false)
+  {
+  }
+
+  BgzfWriter::BgzfWriter (
+    const string & pathToFile,
+    const size_t & nbThreads,
+    const int & level,
+    ThreadPool * pool)
+    : file_(NULL), level_(Z_DEFAULT_COMPRESSION), nbLines_(0), maxJobs_(0),
+      current_(NULL), pool_(NULL), ownPool_(false)
+  {
+    open (pathToFile, nbThreads, level, pool);
+  }
+
+  BgzfWriter::~BgzfWriter (void)
+  {
+    if (file_ != NULL)
+      close ();
+    for (size_t i = 0; i < freeJobs_.size(); ++i)
+      delete freeJobs_[i];
+  }
+
+/** \brief Open a file to write, using either a pool of threads shared with
+ *  other objects, or a pool of its own.
+ */
+  void
+  BgzfWriter::open (
+    const string & pathToFile,
+    const size_t & nbThreads,
+    const int & level,
+    ThreadPool * pool)
+  {
+    if (file_ != NULL)
+      close ();
+    path_ = pathToFile;
+    file_ = fopen (path_.c_str(), "wb");
+    if (file_ == NULL)
+    {
+      cerr << "ERROR: can't open file " << path_ << " to write"
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+    level_ = level;
+    nbLines_ = 0;
+    if (pool != NULL)
+    {
+      pool_ = pool;
+      ownPool_ = false;
+    }
+    else
+    {
+      pool_ = new ThreadPool (max (nbThreads, (size_t) 1));
+      ownPool_ = true;
+    }
+    maxJobs_ = 2 * pool_->size() + 2;
+  }
+
+/** \brief Write data holding a number of lines, only used to tell which
+ *  lines couldn't be written.
+ */
+  void
+  BgzfWriter::write (
+    const char * data,
+    const size_t & len,
+    const size_t & nbLines)
+  {
+    if (current_ == NULL)
+    {
+      if (freeJobs_.empty())
+	current_ = new Job;
+      else
+      {
+	current_ = freeJobs_.back ();
+	freeJobs_.pop_back ();
+      }
+      current_->in.clear ();
+      current_->firstLine = nbLines_ + 1;
+    }
+    nbLines_ += nbLines;
+    current_->in.insert (current_->in.end(), data, data + len);
+    if (current_->in.size() >= 8 * BLOCK_SIZE)
+      submitJob ();
+  }
+
+/** \brief Write a line, adding the end-of-line.
+ */
+  void
+  BgzfWriter::writeLine (
+    const char * line,
+    const size_t & len)
+  {
+    write (line, len);
+    write ("\n", 1, 1);
+  }
+
+  void
+  BgzfWriter::writeLine (
+    const string & line)
+  {
+    writeLine (line.data(), line.size());
+  }
+
+/** \brief Hand the data collected so far to the pool, after having written
+ *  the oldest job if too many are in flight.
+ */
+  void
+  BgzfWriter::submitJob (void)
+  {
+    if (current_ == NULL)
+      return;
+    Job * job = current_;
+    current_ = NULL;
+    job->lastLine = nbLines_;
+    job->done = false;
+    while (jobs_.size() >= maxJobs_)
+      writeJob ();
+    jobs_.push_back (job);
+    int level = level_;
+    pool_->submit ([this, job, level] () {
+	job->deflateBlocks (level);
+	// notify under the lock, as the writer may be destroyed as soon as
+	// its last job is seen done, while the pool lives on
+	lock_guard<mutex> lock (mutex_);
+	job->done = true;
+	done_.notify_all ();
+      });
+  }
+
+/** \brief Wait for the oldest job and write its blocks.
+ */
+  void
+  BgzfWriter::writeJob (void)
+  {
+    Job * job = jobs_.front ();
+    {
+      unique_lock<mutex> lock (mutex_);
+      while (! job->done)
+	done_.wait (lock);
+    }
+    if (job->failed || fwrite (&job->out[0], 1, job->out.size(), file_)
+	!= job->out.size())
+    {
+      cerr << "ERROR: can't write lines " << job->firstLine
+	   << " to " << job->lastLine << " in file " << path_;
+      if (! job->failed)
+	cerr << " (errno=" << errno << ")";
+      cerr << endl;
+      exit (1);
+    }
+    jobs_.pop_front ();
+    freeJobs_.push_back (job);
+  }
+
+/** \brief Write the remaining data and the end-of-file marker of bgzip.
+ */
+  void
+  BgzfWriter::close (void)
+  {
+    static const unsigned char eofBlock[28] = {31, 139, 8, 4, 0, 0, 0, 0, 0,
+					       255, 6, 0, 'B', 'C', 2, 0, 27, 0,
+					       3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    if (file_ == NULL)
+      return;
+    submitJob ();
+    while (! jobs_.empty())
+      writeJob ();
+    if (fwrite (eofBlock, 1, sizeof(eofBlock), file_) != sizeof(eofBlock)
+	|| fclose (file_) != 0)
+    {
+      cerr << "ERROR: can't close the file " << path_
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+    file_ = NULL;
+    if (ownPool_)
+      delete pool_;
+    pool_ = NULL;
+  }
+
+  const size_t BufferedWriter::DEFAULT_SIZE;
+
+  BufferedWriter::BufferedWriter (void)
+    : fd_(-1), writer_(NULL), len_(0), precision_(6)
+  {
+  }
+
+  BufferedWriter::BufferedWriter (
+    const string & pathToFile,
+    const size_t & size)
+    : fd_(-1), writer_(NULL), len_(0), precision_(6)
+  {
+    open (pathToFile, size);
+  }
+
+  BufferedWriter::~BufferedWriter (void)
+  {
+    if (isOpen ())
+      close ();
+  }
+
+  void
+  BufferedWriter::open (
+    const string & pathToFile,
+    const size_t & size)
+  {
+    if (isOpen ())
+      close ();
+    path_ = pathToFile;
+    fd_ = ::open (path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd_ < 0)
+    {
+      cerr << "ERROR: can't open file " << path_ << " to write"
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+    buf_.resize (max (size, (size_t) 1));
+    len_ = 0;
+  }
+
+/** \brief Write through a BgzfWriter, which stays open once this is closed.
+ */
+  void
+  BufferedWriter::open (
+    BgzfWriter * writer,
+    const size_t & size)
+  {
+    if (isOpen ())
+      close ();
+    path_ = writer->path();
+    writer_ = writer;
+    buf_.resize (max (size, (size_t) 1));
+    len_ = 0;
+  }
+
+/** \brief Copy data in the buffer, or write it directly if it is larger
+ *  than the buffer.
+ */
+  void
+  BufferedWriter::write (
+    const char * data,
+    const size_t & len)
+  {
+    if (len_ + len > buf_.size())
+    {
+      flush ();
+      if (len >= buf_.size())
+      {
+	writeOut (data, len);
+	return;
+      }
+    }
+    memcpy (&buf_[len_], data, len);
+    len_ += len;
+  }
+
+  void
+  BufferedWriter::writeDouble (
+    const double & x)
+  {
+    if (len_ + FORMAT_DOUBLE_SIZE > buf_.size())
+      flush ();
+    if (FORMAT_DOUBLE_SIZE > buf_.size())
+    {
+      char tmp[FORMAT_DOUBLE_SIZE];
+      write (tmp, formatDouble (tmp, x, precision_));
+    }
+    else
+      len_ += formatDouble (&buf_[len_], x, precision_);
+  }
+
+/** \brief Write a line, adding the end-of-line.
+ */
+  void
+  BufferedWriter::writeLine (
+    const char * line,
+    const size_t & len)
+  {
+    write (line, len);
+    put ('\n');
+  }
+
+  void
+  BufferedWriter::writeLine (
+    const string & line)
+  {
+    writeLine (line.data(), line.size());
+  }
+
+/** \brief Overwrite data already written, such as a header whose content
+ *  is only known at the end.
+ *  \note Only for plain files, as compressed blocks can't be rewritten.
+ */
+  void
+  BufferedWriter::rewrite (
+    const uint64_t & offset,
+    const char * data,
+    const size_t & len)
+  {
+    flush ();
+    if (writer_ != NULL || pwrite (fd_, data, len, offset) != (ssize_t) len)
+    {
+      cerr << "ERROR: can't rewrite " << len << " bytes at offset " << offset
+	   << " in file " << path_ << endl;
+      exit (1);
+    }
+  }
+
+  void
+  BufferedWriter::writeOut (
+    const char * data,
+    const size_t & len)
+  {
+    if (writer_ != NULL)
+    {
+      writer_->write (data, len, count (data, data + len, '\n'));
+      return;
+    }
+    for (size_t done = 0; done < len; )
+    {
+      ssize_t ret = ::write (fd_, data + done, len - done);
+      if (ret < 0 && errno == EINTR)
+	continue;
+      if (ret <= 0)
+      {
+	cerr << "ERROR: can't write file " << path_
+	     << " (errno=" << errno << ")" << endl;
+	exit (1);
+      }
+      done += ret;
+    }
+  }
+
+/** \brief Hand the buffer to the file or to the BgzfWriter.
+ */
+  void
+  BufferedWriter::flush (void)
+  {
+    if (len_ > 0)
+      writeOut (&buf_[0], len_);
+    len_ = 0;
+  }
+
+  void
+  BufferedWriter::close (void)
+  {
+    if (! isOpen ())
+      return;
+    flush ();
+    if (fd_ >= 0 && ::close (fd_) != 0)
+    {
+      cerr << "ERROR: can't close the file " << path_
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+    fd_ = -1;
+    writer_ = NULL;
+  }
+
+  static const size_t TRANSPOSE_GROUP_SIZE = 64;
+
+/** \brief Write the columns of a block of rows as lines, the rows being
+ *  concatenated in 'rows' and starting at the given offsets, the last
+ *  offset being the end of the last row.
+ *  \note Fields are located for groups of columns at a time, so that each
+ *  row is scanned once without keeping the location of all its fields.
+ */
+  static void
+  writeTransposedRows (
+    const string & rows,
+    const vector<size_t> & starts,
+    const size_t & nbCols,
+    const DelimSet & delims,
+    const char & sep,
+    const string & inFile,
+    const size_t & firstLineId,
+    BufferedWriter & out)
+  {
+    const size_t nbRows = starts.size() - 1, groupSize = TRANSPOSE_GROUP_SIZE;
+    vector<size_t> cursors (starts.begin(), starts.end() - 1);
+    vector<Field> fields (nbRows * groupSize);
+    for (size_t c = 0; c < nbCols; c += groupSize)
+    {
+      size_t g = min (groupSize, nbCols - c);
+      for (size_t r = 0; r < nbRows; ++r)
+      {
+	size_t pos = cursors[r], end = starts[r+1];
+	for (size_t j = 0; j < g; ++j)
+	{
+	  while (pos < end && delims.has (rows[pos]))
+	    ++pos;
+	  Field & field = fields[r * groupSize + j];
+	  field.off = pos;
+	  while (pos < end && ! delims.has (rows[pos]))
+	    ++pos;
+	  field.len = pos - field.off;
+	  if (field.len == 0)
+	  {
+	    cerr << "ERROR: line " << firstLineId + r << " of file " << inFile
+		 << " has " << c + j << " fields instead of " << nbCols
+		 << endl;
+	    exit (1);
+	  }
+	}
+	cursors[r] = pos;
+      }
+      for (size_t j = 0; j < g; ++j)
+      {
+	for (size_t r = 0; r < nbRows; ++r)
+	{
+	  if (r > 0)
+	    out.put (sep);
+	  const Field & field = fields[r * groupSize + j];
+	  out.write (&rows[field.off], field.len);
+	}
+	out.put ('\n');
+      }
+    }
+    for (size_t r = 0; r < nbRows; ++r)
+    {
+      size_t pos = cursors[r];
+      while (pos < starts[r+1] && delims.has (rows[pos]))
+	++pos;
+      if (pos < starts[r+1])
+      {
+	cerr << "ERROR: line " << firstLineId + r << " of file " << inFile
+	     << " has more than " << nbCols << " fields" << endl;
+	exit (1);
+      }
+    }
+  }
+
+/** \brief Write each line of the tiles side by side, then remove them.
+ */
+  static void
+  pasteTiles (
+    const vector<string> & tiles,
+    const size_t & nbLines,
+    const char & sep,
+    BufferedWriter & out)
+  {
+    vector<LineReader *> readers;
+    for (size_t t = 0; t < tiles.size(); ++t)
+      readers.push_back (new LineReader (tiles[t]));
+    const char * line;
+    size_t len;
+    for (size_t l = 0; l < nbLines; ++l)
+    {
+      for (size_t t = 0; t < tiles.size(); ++t)
+      {
+	if (! readers[t]->getline (line, len))
+	{
+	  cerr << "ERROR: file " << tiles[t] << " has less than " << nbLines
+	       << " lines" << endl;
+	  exit (1);
+	}
+	if (t > 0)
+	  out.put (sep);
+	out.write (line, len);
+      }
+      out.put ('\n');
+    }
+    for (size_t t = 0; t < tiles.size(); ++t)
+    {
+      readers[t]->close ();
+      delete readers[t];
+    }
+    removeFiles (tiles);
+  }
+
+/** \brief Write the transpose of a file whose lines have the same number
+ *  of fields, without holding more than about maxMemory bytes.
+ *  \note Blocks of lines filling half of maxMemory are transposed in
+ *  temporary "tiles", named after tmpPrefix, which are then pasted side by
+ *  side at most TRANSPOSE_MAX_TILES at a time, so that the number of open
+ *  files is bounded too. A single line larger than maxMemory is still read
+ *  whole. The input may be gzipped, and is read only once.
+ */
+  void
+  transposeFile (
+    const string & inFile,
+    BufferedWriter & out,
+    const size_t & maxMemory,
+    const string & tmpPrefix,
+    const DelimSet & delims,
+    const char & sep)
+  {
+    LineReader reader (inFile);
+    string rows;
+    vector<size_t> starts;
+    vector<Field> tokens;
+    vector<string> tiles;
+    const char * line;
+    size_t len, nbCols = 0, lineId = 0, firstLineId = 1, nbTiles = 0;
+    bool isEnd = false;
+    while (! isEnd)
+    {
+      isEnd = ! reader.getline (line, len);
+      if (! isEnd)
+      {
+	if (++lineId == 1)
+	  nbCols = tokenize (line, len, delims, tokens);
+	starts.push_back (rows.size());
+	rows.append (line, len);
+      }
+      if (starts.empty()
+	  || (! isEnd && rows.size() + starts.size() * (sizeof(size_t)
+							 + TRANSPOSE_GROUP_SIZE
+							 * sizeof(Field))
+	      < maxMemory / 2))
+	continue;
+      starts.push_back (rows.size());
+      if (isEnd && tiles.empty()) // all lines fit, no need for tiles
+	writeTransposedRows (rows, starts, nbCols, delims, sep, inFile,
+			     firstLineId, out);
+      else
+      {
+	tiles.push_back (tmpPrefix + ".tile" + toString (nbTiles++));
+	BufferedWriter tileOut (tiles.back());
+	writeTransposedRows (rows, starts, nbCols, delims, sep, inFile,
+			     firstLineId, tileOut);
+	tileOut.close ();
+      }
+      firstLineId = lineId + 1;
+      rows.clear ();
+      starts.clear ();
+    }
+    reader.close ();
+    if (tiles.empty())
+      return;
+
+    while (tiles.size() > TRANSPOSE_MAX_TILES)
+    {
+      vector<string> merged;
+      for (size_t t = 0; t < tiles.size(); t += TRANSPOSE_MAX_TILES)
+      {
+	vector<string> group (tiles.begin() + t, tiles.begin()
+			      + min (t + TRANSPOSE_MAX_TILES, tiles.size()));
+	merged.push_back (tmpPrefix + ".tile" + toString (nbTiles++));
+	BufferedWriter mergedOut (merged.back());
+	pasteTiles (group, nbCols, sep, mergedOut);
+	mergedOut.close ();
+      }
+      tiles.swap (merged);
+    }
+    pasteTiles (tiles, nbCols, sep, out);
+  }
+
+/** \brief Return true if the file starts with the magic bytes of gzip.
+ */
+  bool
+  isGzipped (
+    const string & pathToFile)
+  {
+    unsigned char magic[2] = {0, 0};
+    FILE * file = fopen (pathToFile.c_str(), "rb");
+    if (file != NULL)
+    {
+      if (fread (magic, 1, 2, file) != 2)
+	magic[0] = 0;
+      fclose (file);
+    }
+    return magic[0] == 31 && magic[1] == 139;
+  }
+
+/** \brief Return true if the file is a regular, uncompressed file, which
+ *  can hence be mapped in memory (unlike a pipe, for instance).
+ */
+  bool
+  isMappable (
+    const string & pathToFile)
+  {
+    struct stat st;
+    return stat (pathToFile.c_str(), &st) == 0 && S_ISREG(st.st_mode)
+      && ! isGzipped (pathToFile);
+  }
+
+  MappedFile::MappedFile (void)
+    : data_(NULL), size_(0), isOpen_(false)
+  {
+  }
+
+  MappedFile::MappedFile (
+    const string & pathToFile)
+    : data_(NULL), size_(0), isOpen_(false)
+  {
+    open (pathToFile);
+  }
+
+  MappedFile::~MappedFile (void)
+  {
+    close ();
+  }
+
+  void
+  MappedFile::open (
+    const string & pathToFile)
+  {
+    close ();
+    path_ = pathToFile;
+    int fd = ::open (path_.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat (fd, &st) != 0)
+    {
+      cerr << "ERROR: can't open file " << path_ << " to read"
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+    size_ = st.st_size;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    if (size_ > 0)
+    {
+      void * ptr = mmap (NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr == MAP_FAILED)
+      {
+	cerr << "ERROR: can't map file " << path_ << " in memory"
+	     << " (errno=" << errno << ")" << endl;
+	exit (1);
+      }
+      data_ = (char *) ptr;
+      madvise (data_, size_, MADV_SEQUENTIAL);
+    }
+    ::close (fd); // the mapping stays valid
+    isOpen_ = true;
+  }
+
+  void
+  MappedFile::close (void)
+  {
+    if (data_ != NULL)
+      munmap (data_, size_);
+    data_ = NULL;
+    size_ = 0;
+    isOpen_ = false;
+  }
+
+  const size_t LineReader::DEFAULT_BLOCK_SIZE;
+
+  LineReader::LineReader (void)
+    : src_(NULL), data_(NULL), buf_(NULL), cap_(0), beg_(0), end_(0),
+      scan_(0), lineId_(0), nbThreads_(1), eof_(false), hasSeeked_(false)
+  {
+  }
+
+  LineReader::LineReader (
+    const string & pathToFile,
+    const size_t & blockSize,
+    const size_t & nbThreads)
+    : src_(NULL), data_(NULL), buf_(NULL), cap_(0), beg_(0), end_(0),
+      scan_(0), lineId_(0), nbThreads_(1), eof_(false), hasSeeked_(false)
+  {
+    open (pathToFile, blockSize, nbThreads);
+  }
+
+  LineReader::~LineReader (void)
+  {
+    delete src_;
+    free (buf_);
+  }
+
+  void
+  LineReader::open (
+    const string & pathToFile,
+    const size_t & blockSize,
+    const size_t & nbThreads)
+  {
+    if (src_ != NULL || map_.isOpen())
+      close ();
+    path_ = pathToFile;
+    beg_ = end_ = scan_ = lineId_ = 0;
+    nbThreads_ = nbThreads;
+    eof_ = hasSeeked_ = false;
+    if (isMappable (path_))
+    {
+      map_.open (path_);
+      data_ = map_.data();
+      end_ = map_.size();
+      eof_ = true; // nothing more to read than the mapping
+      return;
+    }
+    if (nbThreads > 1 && isBgzf (path_))
+      src_ = new BgzfSource (path_, nbThreads);
+    else
+      src_ = new GzSource (path_);
+    if (cap_ < blockSize)
+    {
+      free (buf_);
+      cap_ = blockSize;
+      buf_ = (char *) malloc (cap_);
+      if (buf_ == NULL)
+      {
+	cerr << "ERROR: can't allocate " << cap_ << " bytes to read file "
+	     << path_ << endl;
+	exit (1);
+      }
+    }
+    data_ = buf_;
+  }
+
+/** \brief Check that the whole file was read, and close it.
+ */
+  void
+  LineReader::close (void)
+  {
+    if (src_ == NULL && ! map_.isOpen())
+      return;
+    if (! eof() && ! hasSeeked_)
+    {
+      cerr << "ERROR: can't read successfully file "
+	   << path_ << " up to the end" << endl;
+      exit (1);
+    }
+    if (src_ != NULL)
+    {
+      src_->close ();
+      delete src_;
+      src_ = NULL;
+    }
+    map_.close ();
+    data_ = NULL;
+  }
+
+/** \brief Read the file again from a checkpoint of its index.
+ */
+  void
+  LineReader::restart (
+    const GzIndex::Checkpoint & start)
+  {
+    if (src_ == NULL)
+    {
+      cerr << "ERROR: can't seek in file " << path_ << ", which isn't gzipped"
+	   << endl;
+      exit (1);
+    }
+    src_->close ();
+    delete src_;
+    if (nbThreads_ > 1 && start.isMember && isBgzf (path_))
+      src_ = new BgzfSource (path_, nbThreads_, start.in);
+    else
+      src_ = new GzSource (path_, start);
+    beg_ = end_ = scan_ = 0;
+    lineId_ = start.line;
+    eof_ = false;
+    hasSeeked_ = true;
+  }
+
+/** \brief Skip the lines before lineId (counting from 0) by inflating at
+ *  most the data between two checkpoints of the index, so that the next
+ *  call to getline returns line lineId.
+ */
+  void
+  LineReader::seekLine (
+    const GzIndex & index,
+    const uint64_t & lineId)
+  {
+    const GzIndex::Checkpoint & start = index.findLine (lineId);
+    restart (start);
+    const char * line;
+    size_t len;
+    if (! start.isLineStart)
+      getline (line, len); // end of the line before the checkpoint
+    while (lineId_ < lineId && getline (line, len))
+      ;
+  }
+
+/** \brief Skip the data before an offset of the inflated file, so that
+ *  the next call to getline returns what follows, up to the end of the
+ *  line it may be in the middle of.
+ *  \note lineId() is then the number of '\n' before the offset.
+ */
+  void
+  LineReader::seekOffset (
+    const GzIndex & index,
+    const uint64_t & offset)
+  {
+    const GzIndex::Checkpoint & start = index.findOffset (offset);
+    restart (start);
+    uint64_t toSkip = offset - start.out;
+    while (toSkip > 0 && (beg_ < end_ || fill ()))
+    {
+      size_t n = (size_t) min (toSkip, (uint64_t) (end_ - beg_));
+      for (const char * p = buf_ + beg_;
+	   (p = (const char *) memchr (p, '\n', buf_ + beg_ + n - p)) != NULL;
+	   ++p)
+	++lineId_;
+      beg_ = scan_ = beg_ + n;
+      toSkip -= n;
+    }
+  }
+
+/** \brief Move the unread bytes at the front of the buffer, and append
+ *  the next block of the file after them.
+ *  \return false if nothing more could be read
+ */
+  bool
+  LineReader::fill (void)
+  {
+    if (eof_)
+      return false;
+    if (beg_ > 0)
+    {
+      memmove (buf_, buf_ + beg_, end_ - beg_);
+      end_ -= beg_;
+      scan_ -= beg_;
+      beg_ = 0;
+    }
+    if (end_ == cap_) // current line is longer than the buffer
+    {
+      cap_ *= 2;
+      buf_ = (char *) realloc (buf_, cap_);
+      if (buf_ == NULL)
+      {
+	cerr << "ERROR: can't allocate " << cap_ << " bytes to read file "
+	     << path_ << endl;
+	exit (1);
+      }
+      data_ = buf_;
+    }
+    size_t nbRead = src_->read (buf_ + end_, cap_ - end_);
+    if (nbRead == 0)
+    {
+      eof_ = true;
+      return false;
+    }
+    end_ += nbRead;
+    return true;
+  }
+
+/** \brief Point to the next line, without copying it.
+ *  \note The last line is returned even if it doesn't end with '\n'.
+ */
+  bool
+  LineReader::getline (
+    const char *& line,
+    size_t & len)
+  {
+    while (true)
+    {
+      const char * nl = (scan_ == end_) ? NULL :
+	(const char *) memchr (data_ + scan_, '\n', end_ - scan_);
+      if (nl != NULL)
+      {
+	line = data_ + beg_;
+	len = nl - line;
+	beg_ = scan_ = nl - data_ + 1;
+	++lineId_;
+	return true;
+      }
+      scan_ = end_;
+      if (! fill ())
+      {
+	if (beg_ == end_)
+	  return false;
+	line = data_ + beg_;
+	len = end_ - beg_;
+	beg_ = scan_ = end_;
+	++lineId_;
+	return true;
+      }
+    }
+  }
+
+/** \brief Copy the next line into a string, re-using its capacity.
+ */
+  bool
+  LineReader::getline (
+    string & line)
+  {
+    const char * ptr;
+    size_t len;
+    if (! getline (ptr, len))
+    {
+      line.clear ();
+      return false;
+    }
+    line.assign (ptr, len);
+    return true;
+  }
+
+/** \brief Return the size of the decompressed content of a gzipped file,
+ *  or 0 if it can't be known without decompressing it.
+ *  \note BGZF files are walked through block by block, reading only their
+ *  headers and trailers. For other files, the size stored in the trailer
+ *  of the last member is used, if it is at least as large as the file
+ *  (ie. the file is likely made of a single member smaller than 4 GB).
+ */
+  static uint64_t
+  getDecompressedSize (
+    const string & pathToFile)
+  {
+    uint64_t total = 0;
+    unsigned char buf[18];
+    struct stat st;
+    int fd = ::open (pathToFile.c_str(), O_RDONLY);
+    if (fd < 0 || fstat (fd, &st) != 0)
+    {
+      if (fd >= 0)
+	::close (fd);
+      return 0;
+    }
+    uint64_t fileSize = st.st_size;
+    if (isBgzf (pathToFile))
+    {
+      uint64_t offset = 0;
+      while (offset < fileSize)
+      {
+	size_t blockSize = 0;
+	if (pread (fd, buf, 18, offset) == 18)
+	  blockSize = getBgzfBlockSize (buf, 18);
+	if (blockSize < 26 || pread (fd, buf, 4, offset + blockSize - 4) != 4)
+	{
+	  total = 0; // not only BGZF blocks, give up
+	  break;
+	}
+	total += readLittleEndian (buf, 4);
+	offset += blockSize;
+      }
+    }
+    else if (fileSize >= 18 && pread (fd, buf, 4, fileSize - 4) == 4)
+    {
+      total = readLittleEndian (buf, 4);
+      if (total < fileSize)
+	total = 0;
+    }
+    ::close (fd);
+    return total;
+  }
+
+/** \brief Record the offset of each line, after having counted them to
+ *  allocate the offsets only once.
+ */
+  template <typename T>
+  static size_t
+  indexLines (
+    const char * data,
+    const size_t & size,
+    vector<T> & offsets)
+  {
+    const char * start = data, * end = data + size, * nl;
+    size_t nbLines = 0;
+    while (start < end
+	   && (nl = (const char *) memchr (start, '\n', end - start)) != NULL)
+    {
+      ++nbLines;
+      start = nl + 1;
+    }
+    if (start < end) // last line without '\n'
+      ++nbLines;
+    
+    offsets.reserve (nbLines + 1);
+    offsets.push_back (0);
+    start = data;
+    while (start < end
+	   && (nl = (const char *) memchr (start, '\n', end - start)) != NULL)
+    {
+      offsets.push_back (nl + 1 - data);
+      start = nl + 1;
+    }
+    if (start < end)
+      offsets.push_back (size + 1);
+    
+    return nbLines;
+  }
+
+/** \brief Read the whole file as an array of lines, without copying each
+ *  one: plain text files are mapped in memory, others are decompressed in
+ *  a single buffer.
+ */
+  int
+  readFile (
+    const string & pathToFile,
+    LineArray & lines)
+  {
+    lines.clear ();
+    size_t size = 0;
+    if (isMappable (pathToFile))
+    {
+      lines.map_.open (pathToFile);
+      lines.data_ = lines.map_.data();
+      size = lines.map_.size();
+    }
+    else
+    {
+      // a last byte is always kept free, to detect the end of the file when
+      // the expected size is exact
+      size_t capacity = getDecompressedSize (pathToFile) + 1;
+      if (capacity == 1)
+	capacity = 1 << 24;
+      lines.arena_ = (char *) malloc (capacity);
+      GzSource src (pathToFile);
+      while (lines.arena_ != NULL)
+      {
+	if (size == capacity)
+	{
+	  capacity += capacity / 2;
+	  lines.arena_ = (char *) realloc (lines.arena_, capacity);
+	  if (lines.arena_ == NULL)
+	    break;
+	}
+	size_t nbRead = src.read (lines.arena_ + size, capacity - size);
+	if (nbRead == 0)
+	  break;
+	size += nbRead;
+      }
+      if (lines.arena_ == NULL)
+      {
+	cerr << "ERROR: can't allocate " << capacity << " bytes to read file "
+	     << pathToFile << endl;
+	exit (1);
+      }
+      src.close ();
+      lines.data_ = lines.arena_;
+    }
+    
+    if (size < 0xffffffffU)
+      lines.nbLines_ = indexLines (lines.data_, size, lines.offsets32_);
+    else
+      lines.nbLines_ = indexLines (lines.data_, size, lines.offsets64_);
+    
+    return 0;
+  }
+
+  string
+  LineArray::str (
+    const size_t & i) const
+  {
+    size_t len;
+    const char * ptr = line (i, len);
+    return string (ptr, len);
+  }
+
+  void
+  LineArray::clear (void)
+  {
+    map_.close ();
+    free (arena_);
+    arena_ = NULL;
+    data_ = NULL;
+    nbLines_ = 0;
+    vector<uint32_t> ().swap (offsets32_);
+    vector<uint64_t> ().swap (offsets64_);
+  }
+
+/** \brief Hash a character range, 8 bytes at a time, with a seed to get
+ *  other hash functions.
+ *  \note The mixing steps are those of splitmix64.
+ */
+  uint64_t
+  hashBytes (
+    const char * s,
+    const size_t & len,
+    const uint64_t & seed)
+  {
+    uint64_t h = (0x9e3779b97f4a7c15ULL + seed) ^ len, w;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+      memcpy (&w, s + i, 8);
+      h = (h ^ w) * 0xbf58476d1ce4e5b9ULL;
+      h ^= h >> 31;
+    }
+    w = 0;
+    memcpy (&w, s + i, len - i);
+    h = (h ^ w) * 0x94d049bb133111ebULL;
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 32;
+    return h;
+  }
+
+  const size_t StringIndex::npos;
+
+  StringIndex::StringIndex (void)
+  {
+    clear ();
+  }
+
+/** \brief Return the slot of a string, or the empty slot where it would be
+ *  inserted.
+ */
+  size_t
+  StringIndex::findSlot (
+    const char * s,
+    const size_t & len,
+    const uint64_t & hash) const
+  {
+    size_t mask = slots_.size() - 1, slot = hash & mask;
+    while (slots_[slot] != 0)
+    {
+      size_t i = slots_[slot] - 1;
+      if (hashes_[i] == (uint32_t) (hash >> 32)
+	  && offsets_[i+1] - offsets_[i] == len
+	  && memcmp (arena_.data() + offsets_[i], s, len) == 0)
+	break;
+      slot = (slot + 1) & mask; // linear probing
+    }
+    return slot;
+  }
+
+  void
+  StringIndex::rehash (
+    const size_t & nbSlots)
+  {
+    slots_.assign (nbSlots, 0);
+    for (size_t i = 0; i < size(); ++i)
+    {
+      size_t len;
+      const char * s = key (i, len);
+      uint64_t hash = hashBytes (s, len);
+      size_t slot = hash & (nbSlots - 1);
+      while (slots_[slot] != 0)
+	slot = (slot + 1) & (nbSlots - 1);
+      slots_[slot] = i + 1;
+    }
+  }
+
+/** \brief Insert a string if it isn't already present.
+ *  \return its position, in the order of first insertion
+ */
+  size_t
+  StringIndex::insert (
+    const char * s,
+    const size_t & len,
+    bool & isNew)
+  {
+    uint64_t hash = hashBytes (s, len);
+    size_t slot = findSlot (s, len, hash);
+    isNew = (slots_[slot] == 0);
+    if (! isNew)
+      return slots_[slot] - 1;
+    if (2 * (size() + 1) > slots_.size()) // keep the load factor below 1/2
+    {
+      rehash (2 * slots_.size());
+      slot = findSlot (s, len, hash);
+    }
+    arena_.insert (arena_.end(), s, s + len);
+    offsets_.push_back (arena_.size());
+    hashes_.push_back ((uint32_t) (hash >> 32));
+    slots_[slot] = size();
+    return size() - 1;
+  }
+
+  size_t
+  StringIndex::insert (
+    const string & s)
+  {
+    bool isNew;
+    return insert (s.data(), s.size(), isNew);
+  }
+
+/** \brief Return the position of a string, or npos if it is absent.
+ */
+  size_t
+  StringIndex::find (
+    const char * s,
+    const size_t & len) const
+  {
+    size_t slot = findSlot (s, len, hashBytes (s, len));
+    return slots_[slot] == 0 ? npos : slots_[slot] - 1;
+  }
+
+  size_t
+  StringIndex::find (
+    const string & s) const
+  {
+    return find (s.data(), s.size());
+  }
+
+  string
+  StringIndex::str (
+    const size_t & i) const
+  {
+    size_t len;
+    const char * s = key (i, len);
+    return string (s, len);
+  }
+
+/** \brief Return a copy of all the strings, in their order of insertion.
+ */
+  vector<string>
+  StringIndex::strings (void) const
+  {
+    vector<string> vStrings;
+    vStrings.reserve (size());
+    for (size_t i = 0; i < size(); ++i)
+      vStrings.push_back (str(i));
+    return vStrings;
+  }
+
+  void
+  StringIndex::reserve (
+    const size_t & nbKeys,
+    const size_t & nbBytes)
+  {
+    arena_.reserve (nbBytes);
+    offsets_.reserve (nbKeys + 1);
+    hashes_.reserve (nbKeys);
+    size_t nbSlots = slots_.size();
+    while (nbSlots < 2 * nbKeys)
+      nbSlots *= 2;
+    if (nbSlots > slots_.size())
+      rehash (nbSlots);
+  }
+
+  void
+  StringIndex::clear (void)
+  {
+    arena_.clear ();
+    offsets_.assign (1, 0);
+    hashes_.clear ();
+    slots_.assign (16, 0);
+  }
+
+  static const double STRING_SET_LOAD = 0.98;
+  static const size_t STRING_SET_BUCKET = 4; // strings per pilot
+  static const size_t STRING_SET_STEP = 16; // slots per offset
+  static const size_t STRING_SET_MAX_SEEDS = 64;
+
+/** \brief Mix the bits of a 64-bit word, as the finalizer of splitmix64.
+ */
+  static inline uint64_t
+  mixBits (
+    uint64_t x)
+  {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+/** \brief Map the high 32 bits of a word to [0, n), n being below 2^32.
+ */
+  static inline size_t
+  reduceBits (
+    const uint64_t & x,
+    const size_t & n)
+  {
+    return ((x >> 32) * (uint64_t) n) >> 32;
+  }
+
+  static inline uint8_t
+  getTag (
+    const uint64_t & hash)
+  {
+    return (hash & 0xff) == 0 ? 1 : (hash & 0xff);
+  }
+
+  const size_t StringSet::npos;
+
+  StringSet::StringSet (void)
+  {
+    clear ();
+  }
+
+  void
+  StringSet::clear (void)
+  {
+    seed_ = 0;
+    size_ = nbAdded_ = nbBloomHashes_ = 0;
+    vector<char> ().swap (arena_);
+    vector<uint16_t> ().swap (pilots_);
+    vector<Slot> ().swap (slots_);
+    vector<uint64_t> ().swap (offsets_);
+    vector<uint64_t> ().swap (bloom_);
+  }
+
+/** \brief Return the length of a string added to a set, moving the
+ *  position to its first byte.
+ */
+  static size_t
+  readAddedLength (
+    const vector<char> & arena,
+    size_t & pos)
+  {
+    size_t len = (unsigned char) arena[pos++];
+    if (len == 255)
+    {
+      len = readLittleEndian ((const unsigned char *) &arena[pos], 4);
+      pos += 4;
+    }
+    return len;
+  }
+
+/** \brief Add a string, possibly already added, before the set is built.
+ *  \note Its length is kept on 1 byte before it, or on 4 bytes after a 255.
+ */
+  void
+  StringSet::add (
+    const char * s,
+    const size_t & len)
+  {
+    if (! slots_.empty() || len > UINT32_MAX)
+    {
+      cerr << "ERROR: can't add a string to a set already built, or longer"
+	   << " than 2^32" << endl;
+      exit (1);
+    }
+    if (len < 255)
+      arena_.push_back ((char) len);
+    else
+    {
+      arena_.push_back ((char) 255);
+      for (size_t i = 0; i < 4; ++i)
+	arena_.push_back ((char) (len >> (8 * i)));
+    }
+    arena_.insert (arena_.end(), s, s + len);
+    ++nbAdded_;
+  }
+
+/** \brief Return the slot of a hash, given by the pilot of its bucket.
+ */
+  size_t
+  StringSet::getSlot (
+    const uint64_t & hash) const
+  {
+    uint16_t pilot = pilots_[reduceBits (hash, pilots_.size())];
+    return reduceBits (mixBits (hash ^ (pilot * 0x9e3779b97f4a7c15ULL)),
+		       slots_.size());
+  }
+
+/** \brief Find a pilot for each bucket, the largest buckets first, such
+ *  that its hashes go to free slots.
+ *  \return false if some bucket has none, or if two hashes are equal
+ */
+  bool
+  StringSet::findPilots (
+    vector<uint64_t> & hashes)
+  {
+    // hashes sorted by value are sorted by bucket too
+    sort (hashes.begin(), hashes.end());
+    hashes.erase (unique (hashes.begin(), hashes.end()), hashes.end());
+    size_t nbSlots = (size_t) (hashes.size() / STRING_SET_LOAD) + 1,
+      nbBuckets = hashes.size() / STRING_SET_BUCKET + 1;
+    if (nbSlots > UINT32_MAX)
+    {
+      cerr << "ERROR: too many strings for a set (" << hashes.size() << ")"
+	   << endl;
+      exit (1);
+    }
+    pilots_.assign (nbBuckets, 0);
+    slots_.assign (nbSlots, Slot());
+    vector<uint32_t> firsts (nbBuckets + 1, 0);
+    size_t maxSize = 0;
+    for (size_t i = 0; i < hashes.size(); ++i)
+      ++firsts[reduceBits (hashes[i], nbBuckets) + 1];
+    for (size_t b = 0; b < nbBuckets; ++b)
+    {
+      maxSize = max (maxSize, (size_t) firsts[b+1]);
+      firsts[b+1] += firsts[b];
+    }
+
+    vector<uint64_t> isTaken ((nbSlots + 63) / 64, 0);
+    vector<size_t> bucketSlots;
+    for (size_t bucketSize = maxSize; bucketSize > 0; --bucketSize)
+      for (size_t b = 0; b < nbBuckets; ++b)
+      {
+	if (firsts[b+1] - firsts[b] != bucketSize)
+	  continue;
+	size_t pilot = 0;
+	for (; pilot <= UINT16_MAX; ++pilot)
+	{
+	  pilots_[b] = pilot;
+	  bucketSlots.clear ();
+	  for (size_t i = firsts[b]; i < firsts[b+1]; ++i)
+	  {
+	    size_t slot = getSlot (hashes[i]);
+	    if ((isTaken[slot / 64] >> (slot % 64)) & 1
+		|| std::find (bucketSlots.begin(), bucketSlots.end(), slot)
+		!= bucketSlots.end())
+	      break;
+	    bucketSlots.push_back (slot);
+	  }
+	  if (bucketSlots.size() == bucketSize)
+	    break;
+	}
+	if (pilot > UINT16_MAX)
+	  return false;
+	for (size_t i = 0; i < bucketSize; ++i)
+	  isTaken[bucketSlots[i] / 64] |= (uint64_t) 1 << (bucketSlots[i] % 64);
+      }
+    size_ = hashes.size();
+    return true;
+  }
+
+/** \brief Move the strings in the order of their slots, dropping those
+ *  added several times.
+ *  \return false if two different strings have the same hash
+ */
+  bool
+  StringSet::placeStrings (void)
+  {
+    vector<uint64_t> positions (slots_.size()); // in the arena as added
+    size_t nbBytes = 0;
+    for (size_t pos = 0; pos < arena_.size(); )
+    {
+      size_t start = pos, len = readAddedLength (arena_, pos);
+      const char * s = &arena_[pos];
+      uint64_t hash = hashBytes (s, len, seed_);
+      size_t slot = getSlot (hash);
+      if (slots_[slot].tag == 0)
+      {
+	slots_[slot].tag = getTag (hash);
+	slots_[slot].len = min (len, (size_t) 255);
+	positions[slot] = start;
+	nbBytes += (len < 255 ? len : 4 + len);
+      }
+      else
+      {
+	size_t other = positions[slot];
+	if (readAddedLength (arena_, other) != len
+	    || memcmp (&arena_[other], s, len) != 0)
+	  return false;
+      }
+      pos += len;
+    }
+
+    // only the lengths of 255 bytes or more stay before their string
+    vector<char> arena;
+    arena.reserve (nbBytes);
+    offsets_.clear ();
+    for (size_t slot = 0; slot < slots_.size(); ++slot)
+    {
+      if (slot % STRING_SET_STEP == 0)
+	offsets_.push_back (arena.size());
+      if (slots_[slot].tag == 0)
+	continue;
+      size_t pos = positions[slot] + 1, len = slots_[slot].len;
+      if (len == 255)
+	len = 4 + readLittleEndian ((const unsigned char *) &arena_[pos], 4);
+      arena.insert (arena.end(), arena_.begin() + pos,
+		    arena_.begin() + pos + len);
+    }
+    vector<char> ().swap (arena_);
+    arena_.swap (arena);
+    return true;
+  }
+
+/** \brief Build the set from all the strings added, and optionally a Bloom
+ *  filter with a number of bits per string, only once.
+ *  \note An other seed is taken in the rare cases where no pilot is found
+ *  for a bucket, or where two strings have the same 64-bit hash.
+ */
+  void
+  StringSet::build (
+    const size_t & bloomBits)
+  {
+    if (! slots_.empty())
+    {
+      cerr << "ERROR: can't build a set already built" << endl;
+      exit (1);
+    }
+    vector<uint64_t> hashes;
+    for (seed_ = 0; seed_ < STRING_SET_MAX_SEEDS; ++seed_)
+    {
+      hashes.clear ();
+      hashes.reserve (nbAdded_);
+      for (size_t pos = 0; pos < arena_.size(); )
+      {
+	size_t len = readAddedLength (arena_, pos);
+	hashes.push_back (hashBytes (&arena_[pos], len, seed_));
+	pos += len;
+      }
+      if (findPilots (hashes))
+      {
+	vector<uint64_t> ().swap (hashes);
+	if (placeStrings ())
+	  break;
+      }
+    }
+    if (seed_ == STRING_SET_MAX_SEEDS)
+    {
+      cerr << "ERROR: can't build the set of " << nbAdded_ << " strings"
+	   << endl;
+      exit (1);
+    }
+
+    bloom_.clear ();
+    nbBloomHashes_ = 0;
+    if (bloomBits > 0 && size_ > 0)
+    {
+      // k = bits * ln(2) hashes minimize the false positives
+      nbBloomHashes_ = min (max ((size_t) (bloomBits * 0.693 + 0.5),
+				 (size_t) 1), (size_t) 16);
+      bloom_.assign (8 * ((size_ * bloomBits + 511) / 512), 0);
+      for (size_t slot = 0, pos = 0; slot < slots_.size(); ++slot)
+      {
+	if (slot % STRING_SET_STEP == 0)
+	  pos = offsets_[slot / STRING_SET_STEP];
+	if (slots_[slot].tag == 0)
+	  continue;
+	size_t len = slots_[slot].len;
+	if (len == 255)
+	{
+	  len = readLittleEndian ((const unsigned char *) &arena_[pos], 4);
+	  pos += 4;
+	}
+	uint64_t h = mixBits (hashBytes (&arena_[pos], len, seed_)),
+	  * block = &bloom_[8 * reduceBits (h, bloom_.size() / 8)];
+	for (size_t k = 0; k < nbBloomHashes_; ++k)
+	{
+	  h *= 0x9e3779b97f4a7c15ULL;
+	  block[(h >> 55) & 7] |= (uint64_t) 1 << ((h >> 49) & 63);
+	}
+	pos += len;
+      }
+    }
+  }
+
+/** \brief Return the slot of a string, or npos if it is absent.
+ */
+  size_t
+  StringSet::find (
+    const char * s,
+    const size_t & len) const
+  {
+    if (slots_.empty())
+      return npos;
+    uint64_t hash = hashBytes (s, len, seed_);
+    if (! bloom_.empty())
+    {
+      uint64_t h = mixBits (hash);
+      const uint64_t * block = &bloom_[8 * reduceBits (h, bloom_.size() / 8)];
+      for (size_t k = 0; k < nbBloomHashes_; ++k)
+      {
+	// h is stepped first, its high bits giving the block
+	h *= 0x9e3779b97f4a7c15ULL;
+	if (! ((block[(h >> 55) & 7] >> ((h >> 49) & 63)) & 1))
+	  return npos;
+      }
+    }
+    size_t slot = getSlot (hash);
+    if (slots_[slot].tag != getTag (hash)
+	|| slots_[slot].len != min (len, (size_t) 255))
+      return npos;
+
+    // the strings of the previous slots are skipped
+    const char * p = arena_.data() + offsets_[slot / STRING_SET_STEP];
+    for (size_t i = slot - slot % STRING_SET_STEP; i < slot; ++i)
+      p += (slots_[i].len < 255 ? slots_[i].len
+	    : 4 + readLittleEndian ((const unsigned char *) p, 4));
+    if (slots_[slot].len == 255)
+    {
+      if (readLittleEndian ((const unsigned char *) p, 4) != len)
+	return npos;
+      p += 4;
+    }
+    return memcmp (p, s, len) == 0 ? slot : npos;
+  }
+
+/** \brief Return the number of bytes taken by the set once built.
+ */
+  size_t
+  StringSet::memory (void) const
+  {
+    return arena_.capacity() + pilots_.capacity() * sizeof(uint16_t)
+      + slots_.capacity() * sizeof(Slot)
+      + offsets_.capacity() * sizeof(uint64_t)
+      + bloom_.capacity() * sizeof(uint64_t);
+  }
+
+  const size_t SizeIndex::npos;
+
+  SizeIndex::SizeIndex (void)
+  {
+    clear ();
+  }
+
+  size_t
+  SizeIndex::findSlot (
+    const size_t & key) const
+  {
+    size_t mask = slots_.size() - 1,
+      slot = hashBytes ((const char *) &key, sizeof(key)) & mask;
+    while (slots_[slot] != 0 && keys_[slots_[slot] - 1] != key)
+      slot = (slot + 1) & mask;
+    return slot;
+  }
+
+  void
+  SizeIndex::rehash (
+    const size_t & nbSlots)
+  {
+    slots_.assign (nbSlots, 0);
+    for (size_t i = 0; i < keys_.size(); ++i)
+    {
+      size_t slot = hashBytes ((const char *) &keys_[i], sizeof(size_t))
+	& (nbSlots - 1);
+      while (slots_[slot] != 0)
+	slot = (slot + 1) & (nbSlots - 1);
+      slots_[slot] = i + 1;
+    }
+  }
+
+  size_t
+  SizeIndex::insert (
+    const size_t & key,
+    bool & isNew)
+  {
+    size_t slot = findSlot (key);
+    isNew = (slots_[slot] == 0);
+    if (! isNew)
+      return slots_[slot] - 1;
+    if (2 * (keys_.size() + 1) > slots_.size())
+    {
+      rehash (2 * slots_.size());
+      slot = findSlot (key);
+    }
+    keys_.push_back (key);
+    slots_[slot] = keys_.size();
+    return keys_.size() - 1;
+  }
+
+  size_t
+  SizeIndex::find (
+    const size_t & key) const
+  {
+    size_t slot = findSlot (key);
+    return slots_[slot] == 0 ? npos : slots_[slot] - 1;
+  }
+
+  void
+  SizeIndex::clear (void)
+  {
+    keys_.clear ();
+    slots_.assign (16, 0);
+  }
+
+  const uint64_t TabixIndex::npos;
+
+  static const char TABIX_MAGIC[4] = {'T', 'B', 'I', 1};
+  static const uint32_t TABIX_UCSC = 0x10000; // 0-based, end excluded
+  static const uint64_t TABIX_MAX_POS = 1ULL << 29;
+
+/** \brief Return the smallest bin of tabix containing [beg, end).
+ */
+  static uint32_t
+  regionToBin (
+    const uint64_t & beg,
+    uint64_t end)
+  {
+    --end;
+    if (beg >> 14 == end >> 14) return 4681 + (beg >> 14);
+    if (beg >> 17 == end >> 17) return 585 + (beg >> 17);
+    if (beg >> 20 == end >> 20) return 73 + (beg >> 20);
+    if (beg >> 23 == end >> 23) return 9 + (beg >> 23);
+    if (beg >> 26 == end >> 26) return 1 + (beg >> 26);
+    return 0;
+  }
+
+/** \brief Return all the bins of tabix overlapping [beg, end).
+ */
+  static void
+  regionToBins (
+    const uint64_t & beg,
+    uint64_t end,
+    vector<uint32_t> & bins)
+  {
+    static const uint32_t firsts[] = {1, 9, 73, 585, 4681};
+    static const int shifts[] = {26, 23, 20, 17, 14};
+    --end;
+    bins.assign (1, 0);
+    for (size_t l = 0; l < 5; ++l)
+      for (uint64_t k = firsts[l] + (beg >> shifts[l]);
+	   k <= firsts[l] + (end >> shifts[l]); ++k)
+	bins.push_back (k);
+  }
+
+  TabixIndex::TabixIndex (void)
+    : format_(TABIX_BED)
+  {
+  }
+
+  void
+  TabixIndex::clear (void)
+  {
+    path_.clear ();
+    names_.clear ();
+    seqs_.clear ();
+  }
+
+/** \brief Load the index of a BGZF file, or build it and save it next to
+ *  the file if it doesn't exist yet or is older than the file.
+ */
+  void
+  TabixIndex::open (
+    const string & pathToFile,
+    const TabixFormat & format)
+  {
+    if (load (pathToFile, format))
+      return;
+    build (pathToFile, format);
+    save ();
+  }
+
+/** \brief Locate the sequence of a record, and give its start and end
+ *  from 0, the end being excluded, whatever the format.
+ *  \return false if the line is a comment or isn't a record
+ *  \note A record ending at or before its start is taken as one base long.
+ */
+  bool
+  TabixIndex::parseRecord (
+    const char * line,
+    const size_t & len,
+    Field & seq,
+    uint64_t & beg,
+    uint64_t & end) const
+  {
+    Field field;
+    size_t b, e = 0;
+    if (len == 0 || line[0] == format_.meta
+	|| ! findToken (line, len, format_.delims, format_.colSeq - 1, seq, true)
+	|| seq.len == 0
+	|| ! findToken (line, len, format_.delims, format_.colBeg - 1, field,
+			true)
+	|| ! parseSize (line + field.off, field.len, b)
+	|| (! format_.isZeroBased && b == 0))
+      return false;
+    if (format_.colEnd > 0
+	&& ! (findToken (line, len, format_.delims, format_.colEnd - 1, field,
+			 true)
+	      && parseSize (line + field.off, field.len, e)))
+      return false;
+    beg = (format_.isZeroBased ? b : b - 1);
+    end = (e > beg ? e : beg + 1);
+    return true;
+  }
+
+/** \brief Read the whole file once, block by block, keeping the virtual
+ *  offsets of the start and of the end of each record.
+ */
+  void
+  TabixIndex::build (
+    const string & pathToFile,
+    const TabixFormat & format)
+  {
+    clear ();
+    path_ = pathToFile;
+    format_ = format;
+    if (! isBgzf (path_))
+    {
+      cerr << "ERROR: file " << path_ << " should be in the BGZF format to"
+	   << " be indexed, eg. compressed with bgzip" << endl;
+      exit (1);
+    }
+    FILE * file = fopen (path_.c_str(), "rb");
+    z_stream strm;
+    memset (&strm, 0, sizeof(strm));
+    if (file == NULL || inflateInit2 (&strm, -15) != Z_OK)
+    {
+      cerr << "ERROR: can't open file " << path_ << " to read"
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+
+    size_t lineId = 0, lastSeqId = npos;
+    uint64_t lastBeg = 0;
+    auto addRecord = [&] (const char * line, const size_t & len,
+			  const uint64_t & vBeg, const uint64_t & vEnd) {
+      Field seq;
+      uint64_t beg, end;
+      if (++lineId <= format_.skip)
+	return;
+      if (! parseRecord (line, len, seq, beg, end))
+      {
+	if (len > 0 && line[0] == format_.meta)
+	  return;
+	cerr << "ERROR: line " << lineId << " of file " << path_
+	     << " should have a sequence in column " << format_.colSeq
+	     << " and a position in column " << format_.colBeg << endl;
+	exit (1);
+      }
+      bool isNew;
+      size_t seqId = names_.insert (line + seq.off, seq.len, isNew);
+      if (isNew)
+	seqs_.push_back (Seq());
+      if ((! isNew && seqId != lastSeqId)
+	  || (seqId == lastSeqId && beg < lastBeg) || end > TABIX_MAX_POS)
+      {
+	cerr << "ERROR: line " << lineId << " of file " << path_
+	     << (end > TABIX_MAX_POS ? " is beyond 2^29" : " isn't sorted")
+	     << endl;
+	exit (1);
+      }
+      lastSeqId = seqId;
+      lastBeg = beg;
+      vector<Chunk> & chunks = seqs_[seqId].bins[regionToBin (beg, end)];
+      if (! chunks.empty() && chunks.back().end == vBeg)
+	chunks.back().end = vEnd;
+      else
+      {
+	Chunk chunk = {vBeg, vEnd};
+	chunks.push_back (chunk);
+      }
+      vector<uint64_t> & linear = seqs_[seqId].linear;
+      if (linear.size() <= (end - 1) >> 14)
+	linear.resize (((end - 1) >> 14) + 1, npos);
+      for (size_t w = beg >> 14; w <= (end - 1) >> 14; ++w)
+	if (linear[w] == npos)
+	  linear[w] = vBeg;
+    };
+
+    vector<char> in, out;
+    string pending; // start of a line continued in the next block
+    uint64_t offset = 0, pendingBeg = 0;
+    bool hasPending = false;
+    while (true)
+    {
+      in.clear ();
+      size_t blockSize = readBgzfBlock (file, in, path_, offset);
+      if (blockSize == 0)
+	break;
+      out.clear ();
+      if (! inflateBgzfBlock (strm, (const unsigned char *) &in[0], blockSize,
+			      out))
+      {
+	cerr << "ERROR: file " << path_ << " has a corrupted BGZF block at"
+	     << " byte " << offset << endl;
+	exit (1);
+      }
+      size_t pos = 0;
+      const char * nl;
+      while (pos < out.size()
+	     && (nl = (const char *) memchr (&out[pos], '\n', out.size() - pos))
+	     != NULL)
+      {
+	size_t i = nl - &out[0];
+	uint64_t vEnd = (i + 1 == out.size() ? (offset + blockSize) << 16
+			 : (offset << 16) | (i + 1));
+	if (hasPending)
+	{
+	  pending.append (&out[pos], i - pos);
+	  addRecord (pending.data(), pending.size(), pendingBeg, vEnd);
+	  hasPending = false;
+	}
+	else
+	  addRecord (&out[pos], i - pos, (offset << 16) | pos, vEnd);
+	pos = i + 1;
+      }
+      if (pos < out.size())
+      {
+	if (! hasPending)
+	{
+	  pending.clear ();
+	  pendingBeg = (offset << 16) | pos;
+	  hasPending = true;
+	}
+	pending.append (&out[pos], out.size() - pos);
+      }
+      offset += blockSize;
+    }
+    if (hasPending) // last line without '\n'
+      addRecord (pending.data(), pending.size(), pendingBeg, offset << 16);
+    inflateEnd (&strm);
+    fclose (file);
+
+    // windows without records start where the previous one does
+    for (size_t s = 0; s < seqs_.size(); ++s)
+    {
+      vector<uint64_t> & linear = seqs_[s].linear;
+      for (size_t w = 0; w < linear.size(); ++w)
+	if (linear[w] == npos)
+	  linear[w] = (w == 0 ? 0 : linear[w-1]);
+    }
+  }
+
+/** \brief Load the index saved next to a BGZF file.
+ *  \return false if there is none, if it is older than the file, or if it
+ *  was built for other columns
+ */
+  bool
+  TabixIndex::load (
+    const string & pathToFile,
+    const TabixFormat & format)
+  {
+    clear ();
+    uint64_t fileSize, fileTime, indexSize, indexTime;
+    string pathToIndex = getPath (pathToFile);
+    if (! doesFileExist (pathToIndex))
+      return false;
+    getFileStamp (pathToFile, fileSize, fileTime);
+    getFileStamp (pathToIndex, indexSize, indexTime);
+    if (indexTime < fileTime)
+      return false;
+
+    vector<char> buf;
+    GzSource src (pathToIndex);
+    for (size_t len = 1; len > 0; )
+    {
+      buf.resize (buf.size() + (1 << 16));
+      len = src.read (&buf[buf.size() - (1 << 16)], 1 << 16);
+      buf.resize (buf.size() - (1 << 16) + len);
+    }
+    src.close ();
+    const unsigned char * p = (const unsigned char *) buf.data(),
+      * end = p + buf.size();
+    auto get = [&] (const size_t & n, uint64_t & val) {
+      if ((size_t) (end - p) < n)
+	return false;
+      val = readLittleEndian (p, n);
+      p += n;
+      return true;
+    };
+
+    uint64_t nbSeqs, flags, colSeq, colBeg, colEnd, meta, skip, namesLen;
+    bool isValid = buf.size() >= 4 && memcmp (p, TABIX_MAGIC, 4) == 0;
+    p += 4;
+    isValid = isValid && get (4, nbSeqs) && get (4, flags) && get (4, colSeq)
+      && get (4, colBeg) && get (4, colEnd) && get (4, meta) && get (4, skip)
+      && get (4, namesLen) && (size_t) (end - p) >= namesLen
+      && flags == (format.isZeroBased ? TABIX_UCSC : 0)
+      && colSeq == format.colSeq && colBeg == format.colBeg
+      && colEnd == format.colEnd && meta == (unsigned char) format.meta
+      && skip == format.skip;
+    if (isValid)
+    {
+      bool isNew;
+      for (const unsigned char * name = p; name < p + namesLen; )
+      {
+	size_t len = strnlen ((const char *) name, p + namesLen - name);
+	names_.insert ((const char *) name, len, isNew);
+	name += len + 1;
+      }
+      p += namesLen;
+      isValid = names_.size() == nbSeqs;
+    }
+    seqs_.resize (isValid ? nbSeqs : 0);
+    for (size_t s = 0; isValid && s < seqs_.size(); ++s)
+    {
+      uint64_t nbBins, bin = 0, nbChunks = 0, nbWindows = 0;
+      isValid = get (4, nbBins);
+      for (size_t b = 0; isValid && b < nbBins; ++b)
+      {
+	isValid = get (4, bin) && get (4, nbChunks)
+	  && (size_t) (end - p) / 16 >= nbChunks;
+	vector<Chunk> & chunks = seqs_[s].bins[bin];
+	chunks.resize (isValid ? nbChunks : 0);
+	for (size_t c = 0; c < chunks.size(); ++c)
+	  get (8, chunks[c].beg) && get (8, chunks[c].end);
+      }
+      isValid = isValid && get (4, nbWindows)
+	&& (size_t) (end - p) / 8 >= nbWindows;
+      seqs_[s].linear.resize (isValid ? nbWindows : 0);
+      for (size_t w = 0; w < seqs_[s].linear.size(); ++w)
+	get (8, seqs_[s].linear[w]);
+    }
+    if (! isValid)
+    {
+      clear ();
+      return false;
+    }
+    path_ = pathToFile;
+    format_ = format;
+    return true;
+  }
+
+/** \brief Save the index next to its BGZF file, as <file>.tbi.
+ *  \note An index which can't be written is only reported, as it can
+ *  still be used, and be built again next time.
+ */
+  void
+  TabixIndex::save (void) const
+  {
+    vector<unsigned char> buf (TABIX_MAGIC, TABIX_MAGIC + 4);
+    string names;
+    for (size_t s = 0; s < names_.size(); ++s)
+    {
+      size_t len;
+      const char * name = names_.key (s, len);
+      names.append (name, len);
+      names += '\0';
+    }
+    writeLittleEndian (buf, names_.size(), 4);
+    writeLittleEndian (buf, format_.isZeroBased ? TABIX_UCSC : 0, 4);
+    writeLittleEndian (buf, format_.colSeq, 4);
+    writeLittleEndian (buf, format_.colBeg, 4);
+    writeLittleEndian (buf, format_.colEnd, 4);
+    writeLittleEndian (buf, (unsigned char) format_.meta, 4);
+    writeLittleEndian (buf, format_.skip, 4);
+    writeLittleEndian (buf, names.size(), 4);
+    buf.insert (buf.end(), names.begin(), names.end());
+    for (size_t s = 0; s < seqs_.size(); ++s)
+    {
+      const Seq & seq = seqs_[s];
+      writeLittleEndian (buf, seq.bins.size(), 4);
+      for (map<uint32_t, vector<Chunk> >::const_iterator it = seq.bins.begin();
+	   it != seq.bins.end(); ++it)
+      {
+	writeLittleEndian (buf, it->first, 4);
+	writeLittleEndian (buf, it->second.size(), 4);
+	for (size_t c = 0; c < it->second.size(); ++c)
+	{
+	  writeLittleEndian (buf, it->second[c].beg, 8);
+	  writeLittleEndian (buf, it->second[c].end, 8);
+	}
+      }
+      writeLittleEndian (buf, seq.linear.size(), 4);
+      for (size_t w = 0; w < seq.linear.size(); ++w)
+	writeLittleEndian (buf, seq.linear[w], 8);
+    }
+
+    string pathToIndex = getPath (path_);
+    FILE * file = fopen (pathToIndex.c_str(), "wb");
+    if (file == NULL)
+    {
+      cerr << "WARNING: can't write index file " << pathToIndex
+	   << " (errno=" << errno << ")" << endl;
+      return;
+    }
+    fclose (file);
+    BgzfWriter writer (pathToIndex);
+    writer.write ((const char *) &buf[0], buf.size());
+    writer.close ();
+  }
+
+/** \brief Parse a region given as "seq", "seq:beg" or "seq:beg-end", with
+ *  positions from 1 and the end included, and commas allowed, as in tabix.
+ *  \return false if it isn't a region, otherwise its start from 0 and its
+ *  end excluded, npos if it ends with the sequence
+ */
+  bool
+  parseRegion (
+    const string & region,
+    string & seq,
+    uint64_t & beg,
+    uint64_t & end)
+  {
+    size_t colon = region.rfind (':'), b, e;
+    seq = region.substr (0, colon);
+    beg = 0;
+    end = TabixIndex::npos;
+    if (colon == string::npos)
+      return ! seq.empty();
+    string range;
+    for (size_t i = colon + 1; i < region.size(); ++i)
+      if (region[i] != ',')
+	range += region[i];
+    size_t dash = range.find ('-');
+    if (seq.empty()
+	|| ! parseSize (range.c_str(), min (dash, range.size()), b) || b == 0)
+      return false;
+    beg = b - 1;
+    if (dash == string::npos || dash + 1 == range.size())
+      return true;
+    if (! parseSize (range.c_str() + dash + 1, range.size() - dash - 1, e)
+	|| e < b)
+      return false;
+    end = e;
+    return true;
+  }
+
+/** \brief Find the ranges of virtual offsets of the records of a sequence
+ *  which may overlap [beg, end), sorted and merged.
+ *  \note As in tabix, the chunks of all the bins overlapping the region are
+ *  kept, minus what comes before the first record of its first window.
+ */
+  void
+  TabixIndex::findChunks (
+    const size_t & seqId,
+    const uint64_t & beg,
+    const uint64_t & end,
+    vector<Chunk> & chunks) const
+  {
+    chunks.clear ();
+    if (seqId >= seqs_.size() || end <= beg || beg >= TABIX_MAX_POS)
+      return;
+    const Seq & seq = seqs_[seqId];
+    uint64_t minOffset = 0;
+    if (! seq.linear.empty())
+      minOffset = seq.linear[min ((size_t) (beg >> 14), seq.linear.size() - 1)];
+    vector<uint32_t> bins;
+    regionToBins (beg, min (end, TABIX_MAX_POS), bins);
+    for (size_t b = 0; b < bins.size(); ++b)
+    {
+      map<uint32_t, vector<Chunk> >::const_iterator it = seq.bins.find (bins[b]);
+      if (it == seq.bins.end())
+	continue;
+      for (size_t c = 0; c < it->second.size(); ++c)
+	if (it->second[c].end > minOffset)
+	{
+	  Chunk chunk = {max (it->second[c].beg, minOffset), it->second[c].end};
+	  chunks.push_back (chunk);
+	}
+    }
+    sort (chunks.begin(), chunks.end(),
+	  [] (const Chunk & a, const Chunk & b) { return a.beg < b.beg; });
+    size_t nbMerged = 0;
+    for (size_t c = 0; c < chunks.size(); ++c)
+    {
+      if (nbMerged > 0 && chunks[nbMerged-1].end >= chunks[c].beg)
+	chunks[nbMerged-1].end = max (chunks[nbMerged-1].end, chunks[c].end);
+      else
+	chunks[nbMerged++] = chunks[c];
+    }
+    chunks.resize (nbMerged);
+  }
+
+  static const size_t REGION_CACHE_BLOCKS = 256;
+
+  RegionReader::RegionReader (void)
+    : index_(NULL), file_(NULL), chunk_(0), seqId_(0), beg_(0), end_(0),
+      block_(NULL), blockOffset_(TabixIndex::npos), pos_(0)
+  {
+  }
+
+  RegionReader::RegionReader (
+    const string & pathToFile,
+    const TabixIndex & index)
+    : index_(NULL), file_(NULL), chunk_(0), seqId_(0), beg_(0), end_(0),
+      block_(NULL), blockOffset_(TabixIndex::npos), pos_(0)
+  {
+    open (pathToFile, index);
+  }
+
+  RegionReader::~RegionReader (void)
+  {
+    close ();
+  }
+
+  void
+  RegionReader::open (
+    const string & pathToFile,
+    const TabixIndex & index)
+  {
+    close ();
+    path_ = pathToFile;
+    index_ = &index;
+    file_ = fopen (path_.c_str(), "rb");
+    memset (&strm_, 0, sizeof(strm_));
+    if (file_ == NULL || inflateInit2 (&strm_, -15) != Z_OK)
+    {
+      cerr << "ERROR: can't open file " << path_ << " to read"
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+  }
+
+  void
+  RegionReader::close (void)
+  {
+    if (file_ == NULL)
+      return;
+    inflateEnd (&strm_);
+    fclose (file_);
+    file_ = NULL;
+    chunks_.clear ();
+    chunk_ = 0;
+    cache_.clear ();
+    cached_.clear ();
+    block_ = NULL;
+    blockOffset_ = TabixIndex::npos;
+  }
+
+/** \brief Go to the first chunk which may overlap a region.
+ *  \return false if no record of the sequence may overlap it
+ */
+  bool
+  RegionReader::seek (
+    const size_t & seqId,
+    const uint64_t & beg,
+    const uint64_t & end)
+  {
+    index_->findChunks (seqId, beg, end, chunks_);
+    chunk_ = 0;
+    seqId_ = seqId;
+    beg_ = beg;
+    end_ = end;
+    if (chunks_.empty())
+      return false;
+    loadBlock (chunks_[0].beg >> 16);
+    pos_ = chunks_[0].beg & 0xffff;
+    return true;
+  }
+
+/** \brief Go to a region given as "seq", "seq:beg" or "seq:beg-end", with
+ *  positions from 1 and the end included, as for tabix.
+ *  \return false if no record may overlap it
+ */
+  bool
+  RegionReader::seek (
+    const string & region)
+  {
+    string seq;
+    uint64_t beg, end;
+    if (! parseRegion (region, seq, beg, end))
+    {
+      cerr << "ERROR: region '" << region << "' should be as 'seq',"
+	   << " 'seq:beg' or 'seq:beg-end'" << endl;
+      exit (1);
+    }
+    return seek (index_->findSeq (seq), beg, end);
+  }
+
+/** \brief Make current the block at an offset of the file, inflating it
+ *  unless it is cached, and empty at the end of the file.
+ */
+  void
+  RegionReader::loadBlock (
+    const uint64_t offset) // a copy, the block holding it may be evicted
+  {
+    pos_ = 0;
+    if (block_ != NULL && offset == blockOffset_)
+      return;
+    blockOffset_ = offset;
+    map<uint64_t, Block>::const_iterator it = cache_.find (offset);
+    if (it != cache_.end())
+    {
+      block_ = &it->second;
+      return;
+    }
+
+    if (cached_.size() == REGION_CACHE_BLOCKS)
+    {
+      cache_.erase (cached_.front());
+      cached_.pop_front ();
+    }
+    Block & block = cache_[offset];
+    cached_.push_back (offset);
+    block_ = &block;
+    block.next = TabixIndex::npos;
+    in_.clear ();
+    size_t blockSize = 0;
+    if (fseeko (file_, (off_t) offset, SEEK_SET) == 0)
+      blockSize = readBgzfBlock (file_, in_, path_, offset);
+    if (blockSize == 0)
+      return;
+    if (! inflateBgzfBlock (strm_, (const unsigned char *) &in_[0], blockSize,
+			    block.data))
+    {
+      cerr << "ERROR: file " << path_ << " has a corrupted BGZF block at"
+	   << " byte " << offset << endl;
+      exit (1);
+    }
+    block.next = offset + blockSize;
+  }
+
+/** \brief Return the virtual offset of the next byte, at the start of the
+ *  next block when the current one is fully read, as in the index.
+ */
+  uint64_t
+  RegionReader::tell (void)
+  {
+    while (pos_ == block_->data.size() && block_->next != TabixIndex::npos)
+      loadBlock (block_->next);
+    if (pos_ == block_->data.size())
+      return TabixIndex::npos;
+    return (blockOffset_ << 16) | pos_;
+  }
+
+/** \brief Read the next record overlapping the region, without its '\n',
+ *  and give its start and end from 0, the end being excluded.
+ *  \note The line is valid until the next call.
+ */
+  bool
+  RegionReader::getline (
+    const char * & line,
+    size_t & len,
+    uint64_t & beg,
+    uint64_t & end)
+  {
+    Field seq;
+    while (readLine (line, len))
+    {
+      if (! index_->parseRecord (line, len, seq, beg, end))
+	continue;
+      if (beg >= end_ || index_->findSeq (line + seq.off, seq.len) != seqId_)
+      {
+	chunk_ = chunks_.size(); // records are sorted
+	return false;
+      }
+      if (end > beg_)
+	return true;
+    }
+    return false;
+  }
+
+  bool
+  RegionReader::getline (
+    const char * & line,
+    size_t & len)
+  {
+    uint64_t beg, end;
+    return getline (line, len, beg, end);
+  }
+
+/** \brief Read the next line of the chunks, without its '\n'.
+ */
+  bool
+  RegionReader::readLine (
+    const char * & line,
+    size_t & len)
+  {
+    uint64_t offset;
+    while (chunk_ < chunks_.size()
+	   && ((offset = tell ()) == TabixIndex::npos
+	       || offset >= chunks_[chunk_].end))
+    {
+      if (offset == TabixIndex::npos || ++chunk_ == chunks_.size())
+      {
+	chunk_ = chunks_.size();
+	return false;
+      }
+      if (chunks_[chunk_].beg > offset)
+      {
+	loadBlock (chunks_[chunk_].beg >> 16);
+	pos_ = chunks_[chunk_].beg & 0xffff;
+      }
+    }
+    if (chunk_ == chunks_.size())
+      return false;
+
+    line_.clear ();
+    while (true)
+    {
+      const char * start = &block_->data[pos_],
+	* nl = (const char *) memchr (start, '\n', block_->data.size() - pos_);
+      size_t n = (nl == NULL ? block_->data.size() - pos_ : nl - start);
+      pos_ += n + (nl != NULL);
+      if (nl != NULL && line_.empty())
+      {
+	line = start;
+	len = n;
+	return true;
+      }
+      line_.append (start, n);
+      if (nl != NULL || tell () == TabixIndex::npos)
+	break;
+    }
+    line = line_.data();
+    len = line_.size();
+    return true;
+  }
+
 /** \brief Used by scandir.
  *  \note unused parameter, see http://stackoverflow.com/q/1486904/597069
  */
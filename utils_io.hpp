@@ -21,14 +21,22 @@
 #define UTILS_UTILS_IO_HPP
 
 #include <cstdlib>
+#include <cstdio>
 #include <ctime>
+#include <stdint.h>
 
 #include <vector>
+#include <deque>
 #include <map>
 #include <string>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include "zlib.h"
 
@@ -46,6 +54,84 @@
 
 namespace utils {
 
+/** \brief Set of delimiters, as a 256-bit lookup table.
+ *  \note The constructor is constexpr, so that sets declared as constants
+ *  are built at compile time. The first four delimiters are also kept
+ *  to be compared 16 bytes at a time when SSE2 is available.
+ */
+  class DelimSet
+  {
+  public:
+    constexpr DelimSet (const char * delims)
+      : bits_{word(delims, 0), word(delims, 1), word(delims, 2),
+	word(delims, 3)},
+	first_{at(delims, 0), at(delims, 1), at(delims, 2), at(delims, 3)},
+	nbDelims_(length(delims))
+    {}
+    constexpr DelimSet (char delim)
+      : bits_{bit(delim, 0), bit(delim, 1), bit(delim, 2), bit(delim, 3)},
+	first_{delim, 0, 0, 0}, nbDelims_(1)
+    {}
+
+    bool has (unsigned char c) const
+    {
+      return (bits_[c >> 6] >> (c & 63)) & 1;
+    }
+    const char * first (void) const { return first_; }
+    size_t size (void) const { return nbDelims_; }
+
+  private:
+    static constexpr uint64_t bit (char c, unsigned w)
+    {
+      return ((unsigned char) c >> 6) == w ?
+	(uint64_t) 1 << ((unsigned char) c & 63) : 0;
+    }
+    static constexpr uint64_t word (const char * d, unsigned w)
+    {
+      return *d == 0 ? 0 : (bit(*d, w) | word(d + 1, w));
+    }
+    static constexpr char at (const char * d, size_t i)
+    {
+      return *d == 0 ? 0 : (i == 0 ? *d : at(d + 1, i - 1));
+    }
+    static constexpr size_t length (const char * d)
+    {
+      return *d == 0 ? 0 : 1 + length(d + 1);
+    }
+
+    uint64_t bits_[4];
+    char first_[4];
+    size_t nbDelims_;
+  };
+
+  constexpr DelimSet DELIMS_SPACE(' ');
+  constexpr DelimSet DELIMS_TAB('\t');
+  constexpr DelimSet DELIMS_WHITESPACE(" \t");
+  constexpr DelimSet DELIMS_COLUMN(" \t,");
+
+/** \brief Location of a token in a line, as an offset from the beginning
+ *  of the line and a length.
+ */
+  struct Field
+  {
+    size_t off;
+    size_t len;
+  };
+
+  size_t tokenize (const char * s, const size_t & len, const DelimSet & delims,
+		   Field * fields, const size_t & maxFields,
+		   const bool & keepEmpty = false);
+
+  size_t tokenize (const char * s, const size_t & len, const DelimSet & delims,
+		   std::vector<Field> & fields, const bool & keepEmpty = false);
+
+  bool findToken (const char * s, const size_t & len, const DelimSet & delims,
+		  const size_t & idx, Field & field,
+		  const bool & keepEmpty = false);
+
+  size_t tokenize (const std::string & s, const DelimSet & delims,
+		   std::vector<Field> & fields, const bool & keepEmpty = false);
+
   std::vector<std::string> & split (const std::string & s, char delim, std::vector<std::string> & tokens);
 
   std::vector<std::string> split (const std::string & s, char delim);
@@ -57,6 +143,15 @@ namespace utils {
 
   std::string split (const std::string & s, const char * delim, const size_t & idx);
 
+  bool parseSize (const char * s, const size_t & len, size_t & val);
+
+  bool parseDouble (const char * s, const size_t & len, double & val);
+
+  const size_t FORMAT_DOUBLE_SIZE = 32;
+
+  size_t formatDouble (char * buf, const double & x,
+		       const int & precision = 6);
+
   double getElapsedTime (const clock_t & startTime);
 
   std::string getElapsedTime (const time_t & startRawTime, const time_t & endRawTime);
@@ -83,6 +178,704 @@ namespace utils {
   void gzwriteLine (gzFile & fileStream, const std::string & line,
 		    const std::string & pathToFile, const size_t & lineId);
 
+/** \brief Fixed set of threads running the tasks submitted to it, in the
+ *  order of submission.
+ *  \note The destructor waits for all submitted tasks to finish.
+ */
+  class ThreadPool
+  {
+  public:
+    explicit ThreadPool (const size_t & nbThreads);
+    ~ThreadPool (void);
+
+    void submit (const std::function<void(void)> & task);
+    size_t size (void) const { return threads_.size(); }
+
+  private:
+    ThreadPool (const ThreadPool &);
+    ThreadPool & operator= (const ThreadPool &);
+    void work (void);
+
+    std::vector<std::thread> threads_;
+    std::deque<std::function<void(void)> > tasks_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stop_;
+  };
+
+/** \brief Interface of the objects feeding a LineReader with bytes.
+ *  \note read() returns 0 only at the end of the data, and exits the
+ *  program with an error message if the data can't be read.
+ */
+  class ByteSource
+  {
+  public:
+    virtual ~ByteSource (void) {}
+    virtual size_t read (char * buf, const size_t & len) = 0;
+    virtual void close (void) = 0;
+  };
+
+/** \brief Raw bytes of a file, read by a background thread which keeps
+ *  several blocks ahead of the consumer, so that disk (or network) reads
+ *  and parsing overlap.
+ *  \note Blocks are handed off through a single-producer single-consumer
+ *  ring whose positions are atomic, so that no lock is taken as long as the
+ *  ring is neither empty nor full. The kernel is also told to read ahead
+ *  the next blocks.
+ */
+  class PrefetchSource : public ByteSource
+  {
+  public:
+    static const size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+    static const size_t DEFAULT_NB_BLOCKS = 4;
+
+    explicit PrefetchSource (const std::string & pathToFile,
+			     const size_t & blockSize = DEFAULT_BLOCK_SIZE,
+			     const size_t & nbBlocks = DEFAULT_NB_BLOCKS,
+			     const uint64_t & offset = 0);
+    ~PrefetchSource (void);
+    size_t read (char * buf, const size_t & len);
+    void close (void);
+
+  private:
+    struct Block
+    {
+      char * data;
+      size_t len;
+      int errnum; // errno of a failed read, 0 otherwise
+    };
+    PrefetchSource (const PrefetchSource &);
+    PrefetchSource & operator= (const PrefetchSource &);
+    void produce (void);
+    void sleepUntil (std::atomic<bool> & isWaiting,
+		     const std::function<bool(void)> & isReady);
+    void wake (std::atomic<bool> & isWaiting);
+
+    std::string path_;
+    int fd_;
+    size_t blockSize_, pos_; // pos_ in the block at head_
+    bool end_;
+    std::vector<Block> blocks_;
+    std::atomic<size_t> head_, tail_; // nb of blocks consumed, produced
+    std::atomic<bool> stop_, consumerWaits_, producerWaits_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::thread thread_;
+  };
+
+/** \brief Checkpoints from which a gzip file can be inflated without
+ *  inflating what comes before, with the number of lines before each.
+ *  \note As in zran.c from zlib, a checkpoint inside a gzip member is at
+ *  the boundary of a deflate block, and keeps the last 32 kB inflated
+ *  before it. The start of a member, as every BGZF block, needs nothing.
+ *  Checkpoints are spaced by a few MB of inflated data, and the index is
+ *  saved next to the file, as <file>.gzidx, to be built only once.
+ */
+  class GzIndex
+  {
+  public:
+    static const size_t DEFAULT_SPACING = 4 << 20;
+
+    struct Checkpoint
+    {
+      uint64_t in; // offset in the gzip file
+      uint64_t out; // offset in the inflated data
+      uint64_t line; // nb of '\n' before out
+      int bits; // nb of bits of the byte before in, still to inflate
+      bool isMember; // at the start of a gzip member
+      bool isLineStart; // at the start of a line
+      std::vector<unsigned char> window; // inflated bytes before out
+    };
+
+    GzIndex (void);
+
+    void open (const std::string & pathToFile,
+	       const size_t & spacing = DEFAULT_SPACING);
+    void build (const std::string & pathToFile,
+		const size_t & spacing = DEFAULT_SPACING);
+    bool load (const std::string & pathToFile);
+    void save (void) const;
+    void clear (void);
+
+    const Checkpoint & findLine (const uint64_t & lineId) const;
+    const Checkpoint & findOffset (const uint64_t & offset) const;
+    size_t size (void) const { return checkpoints_.size(); }
+    const Checkpoint & operator[] (const size_t & i) const
+    {
+      return checkpoints_[i];
+    }
+    uint64_t nbLines (void) const { return nbLines_; }
+    uint64_t inflatedSize (void) const { return inflatedSize_; }
+    const std::string & path (void) const { return path_; }
+    static std::string getPath (const std::string & pathToFile)
+    {
+      return pathToFile + ".gzidx";
+    }
+
+  private:
+    std::string path_;
+    uint64_t fileSize_, fileTime_, inflatedSize_, nbLines_;
+    std::vector<Checkpoint> checkpoints_;
+  };
+
+/** \brief Bytes of a file, inflated if it is gzipped (possibly with
+ *  several members, as BGZF), as is otherwise.
+ *  \note The compressed bytes come from a PrefetchSource, so that they are
+ *  read while the previous ones are inflated.
+ */
+  class GzSource : public ByteSource
+  {
+  public:
+    explicit GzSource (const std::string & pathToFile);
+    GzSource (const std::string & pathToFile,
+	      const GzIndex::Checkpoint & start);
+    ~GzSource (void);
+    size_t read (char * buf, const size_t & len);
+    void close (void);
+
+  private:
+    GzSource (const GzSource &);
+    GzSource & operator= (const GzSource &);
+    size_t fillInput (const size_t & minLen);
+    bool startsMember (void) const;
+
+    std::string path_;
+    PrefetchSource raw_;
+    std::vector<unsigned char> in_;
+    z_stream strm_;
+    enum { UNKNOWN, PLAIN, GZIP, END } mode_;
+    bool isRaw_; // inflating a deflate stream without its gzip header
+  };
+
+  bool isBgzf (const std::string & pathToFile);
+
+/** \brief Bytes of a BGZF file, with its blocks inflated by a pool of
+ *  threads but handed out in the order of the file.
+ *  \note BGZF, as written by bgzip, is a series of gzip members of at most
+ *  64 kB each, with the size of each member stored in its header.
+ */
+  class BgzfSource : public ByteSource
+  {
+  public:
+    BgzfSource (const std::string & pathToFile, const size_t & nbThreads,
+		const uint64_t & offset = 0);
+    ~BgzfSource (void);
+    size_t read (char * buf, const size_t & len);
+    void close (void);
+
+  private:
+    struct Job;
+    BgzfSource (const BgzfSource &);
+    BgzfSource & operator= (const BgzfSource &);
+    void submitJobs (void);
+    void waitJobs (void);
+
+    std::string path_;
+    FILE * file_;
+    uint64_t offset_; // in the compressed file
+    bool fileEnd_;
+    size_t maxJobs_, pos_;
+    std::deque<Job *> jobs_, freeJobs_;
+    std::mutex mutex_;
+    std::condition_variable done_;
+    ThreadPool pool_;
+  };
+
+/** \brief Write a BGZF file, compressing its blocks on a pool of threads
+ *  while the caller keeps on writing.
+ *  \note Data is collected in blocks of at most 65280 bytes, as bgzip
+ *  does, so that the output can be indexed and read back in parallel, but
+ *  it remains a valid gzip file. Errors are reported with the range of
+ *  lines of the block that couldn't be written.
+ */
+  class BgzfWriter
+  {
+  public:
+    static const size_t BLOCK_SIZE = 0xff00;
+
+    BgzfWriter (void);
+    BgzfWriter (const std::string & pathToFile, const size_t & nbThreads = 1,
+		const int & level = Z_DEFAULT_COMPRESSION,
+		ThreadPool * pool = NULL);
+    ~BgzfWriter (void);
+
+    void open (const std::string & pathToFile, const size_t & nbThreads = 1,
+	       const int & level = Z_DEFAULT_COMPRESSION,
+	       ThreadPool * pool = NULL);
+    void write (const char * data, const size_t & len,
+		const size_t & nbLines = 0);
+    void writeLine (const char * line, const size_t & len);
+    void writeLine (const std::string & line);
+    void close (void);
+    size_t nbLines (void) const { return nbLines_; }
+    const std::string & path (void) const { return path_; }
+
+  private:
+    struct Job;
+    BgzfWriter (const BgzfWriter &);
+    BgzfWriter & operator= (const BgzfWriter &);
+    void submitJob (void);
+    void writeJob (void);
+
+    std::string path_;
+    FILE * file_;
+    int level_;
+    size_t nbLines_, maxJobs_;
+    Job * current_;
+    std::deque<Job *> jobs_, freeJobs_;
+    std::mutex mutex_;
+    std::condition_variable done_;
+    ThreadPool * pool_;
+    bool ownPool_;
+  };
+
+/** \brief Collect text in a large buffer, handed to a file or to a
+ *  BgzfWriter only when full, so that writing a line or a number costs no
+ *  system call and no flush.
+ *  \note Doubles are written with formatDouble, by default as ostream does.
+ */
+  class BufferedWriter
+  {
+  public:
+    static const size_t DEFAULT_SIZE = 1 << 20;
+
+    BufferedWriter (void);
+    BufferedWriter (const std::string & pathToFile,
+		    const size_t & size = DEFAULT_SIZE);
+    ~BufferedWriter (void);
+
+    void open (const std::string & pathToFile,
+	       const size_t & size = DEFAULT_SIZE);
+    void open (BgzfWriter * writer, const size_t & size = DEFAULT_SIZE);
+    void setPrecision (const int & precision) { precision_ = precision; }
+    void write (const char * data, const size_t & len);
+    void write (const std::string & s) { write (s.data(), s.size()); }
+    void put (const char & c)
+    {
+      if (len_ == buf_.size())
+	flush ();
+      buf_[len_++] = c;
+    }
+    void writeDouble (const double & x);
+    void writeLine (const char * line, const size_t & len);
+    void writeLine (const std::string & line);
+    void rewrite (const uint64_t & offset, const char * data,
+		  const size_t & len);
+    void flush (void);
+    void close (void);
+    bool isOpen (void) const { return fd_ >= 0 || writer_ != NULL; }
+    const std::string & path (void) const { return path_; }
+
+  private:
+    BufferedWriter (const BufferedWriter &);
+    BufferedWriter & operator= (const BufferedWriter &);
+    void writeOut (const char * data, const size_t & len);
+
+    std::string path_;
+    int fd_;
+    BgzfWriter * writer_;
+    std::vector<char> buf_;
+    size_t len_;
+    int precision_;
+  };
+
+  const size_t TRANSPOSE_MAX_TILES = 64;
+
+  void transposeFile (const std::string & inFile, BufferedWriter & out,
+		      const size_t & maxMemory, const std::string & tmpPrefix,
+		      const DelimSet & delims = DELIMS_WHITESPACE,
+		      const char & sep = ' ');
+
+  bool isGzipped (const std::string & pathToFile);
+
+  bool isMappable (const std::string & pathToFile);
+
+/** \brief Read-only mapping of a whole file in memory, with hints to the
+ *  kernel that it will be read sequentially.
+ */
+  class MappedFile
+  {
+  public:
+    MappedFile (void);
+    explicit MappedFile (const std::string & pathToFile);
+    ~MappedFile (void);
+
+    void open (const std::string & pathToFile);
+    void close (void);
+    bool isOpen (void) const { return isOpen_; }
+    const char * data (void) const { return data_; }
+    size_t size (void) const { return size_; }
+
+  private:
+    MappedFile (const MappedFile &);
+    MappedFile & operator= (const MappedFile &);
+
+    std::string path_;
+    char * data_;
+    size_t size_;
+    bool isOpen_;
+  };
+
+/** \brief Read a (gzipped or not) text file line by line, by large blocks.
+ *  \note Lines are handed out as views into an internal buffer, without
+ *  their trailing '\n', and remain valid until the next call to getline.
+ *  Plain text files are mapped in memory, so that lines point directly
+ *  into the mapping, and with more than one thread, BGZF files are
+ *  inflated in parallel. Given a GzIndex, a gzipped file can be read from
+ *  any line or offset, in which case it needn't be read up to the end.
+ */
+  class LineReader
+  {
+  public:
+    static const size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+
+    LineReader (void);
+    LineReader (const std::string & pathToFile,
+		const size_t & blockSize = DEFAULT_BLOCK_SIZE,
+		const size_t & nbThreads = 1);
+    ~LineReader (void);
+
+    void open (const std::string & pathToFile,
+	       const size_t & blockSize = DEFAULT_BLOCK_SIZE,
+	       const size_t & nbThreads = 1);
+    void close (void);
+    bool getline (const char *& line, size_t & len);
+    bool getline (std::string & line);
+    void seekLine (const GzIndex & index, const uint64_t & lineId);
+    void seekOffset (const GzIndex & index, const uint64_t & offset);
+    bool eof (void) const { return eof_ && beg_ == end_; }
+    size_t lineId (void) const { return lineId_; }
+    const std::string & path (void) const { return path_; }
+
+  private:
+    LineReader (const LineReader &);
+    LineReader & operator= (const LineReader &);
+    bool fill (void);
+    void restart (const GzIndex::Checkpoint & start);
+
+    std::string path_;
+    ByteSource * src_;
+    MappedFile map_;
+    const char * data_; // either buf_ or the mapping
+    char * buf_;
+    size_t cap_, beg_, end_, scan_, lineId_, nbThreads_;
+    bool eof_, hasSeeked_;
+  };
+
+/** \brief All the lines of a file, as offsets into a single buffer: the
+ *  file mapped in memory if it is plain text, its decompressed content
+ *  otherwise.
+ *  \note Lines don't include their trailing '\n' and aren't
+ *  NUL-terminated. The buffer and the offsets are each allocated once, and
+ *  offsets take 4 bytes per line when the content is smaller than 4 GB.
+ */
+  class LineArray
+  {
+  public:
+    LineArray (void) : arena_(NULL), data_(NULL), nbLines_(0) {}
+    ~LineArray (void) { clear(); }
+
+    size_t size (void) const { return nbLines_; }
+    const char * line (const size_t & i, size_t & len) const
+    {
+      uint64_t beg = offset(i);
+      len = offset(i+1) - beg - 1;
+      return data_ + beg;
+    }
+    std::string str (const size_t & i) const;
+    void clear (void);
+
+  private:
+    LineArray (const LineArray &);
+    LineArray & operator= (const LineArray &);
+    friend int readFile (const std::string & pathToFile, LineArray & lines);
+    uint64_t offset (const size_t & i) const
+    {
+      return offsets64_.empty() ? offsets32_[i] : offsets64_[i];
+    }
+
+    MappedFile map_;
+    char * arena_;
+    const char * data_;
+    size_t nbLines_;
+    // of each line, then of the end + 1
+    std::vector<uint32_t> offsets32_;
+    std::vector<uint64_t> offsets64_;
+  };
+
+  int readFile (const std::string & pathToFile, LineArray & lines);
+
+  uint64_t hashBytes (const char * s, const size_t & len,
+		      const uint64_t & seed = 0);
+
+/** \brief Set of strings keeping the order in which they were first
+ *  inserted, with an open-addressing hash table giving the position of any
+ *  of them in O(1).
+ *  \note Strings are interned one after the other in a single arena, so
+ *  that looking up a character range from a line allocates nothing.
+ */
+  class StringIndex
+  {
+  public:
+    static const size_t npos = (size_t) -1;
+
+    StringIndex (void);
+
+    size_t insert (const char * s, const size_t & len, bool & isNew);
+    size_t insert (const std::string & s);
+    size_t find (const char * s, const size_t & len) const;
+    size_t find (const std::string & s) const;
+    bool contains (const char * s, const size_t & len) const
+    {
+      return find(s, len) != npos;
+    }
+    bool contains (const std::string & s) const { return find(s) != npos; }
+    size_t size (void) const { return offsets_.size() - 1; }
+    const char * key (const size_t & i, size_t & len) const
+    {
+      len = offsets_[i+1] - offsets_[i];
+      return arena_.data() + offsets_[i];
+    }
+    std::string str (const size_t & i) const;
+    std::vector<std::string> strings (void) const;
+    void reserve (const size_t & nbKeys, const size_t & nbBytes = 0);
+    void clear (void);
+
+  private:
+    size_t findSlot (const char * s, const size_t & len,
+		     const uint64_t & hash) const;
+    void rehash (const size_t & nbSlots);
+
+    std::vector<char> arena_;
+    std::vector<uint64_t> offsets_; // of each key, then of the end
+    std::vector<uint32_t> hashes_; // low bits of the hash of each key
+    std::vector<uint32_t> slots_; // 0 if empty, position + 1 otherwise
+  };
+
+/** \brief Static set of strings, built once all are added, taking a few
+ *  bytes per string on top of the strings themselves, for lists too large
+ *  for a StringIndex.
+ *  \note A perfect hash function gives each string its own slot, out of
+ *  n / 0.98, with a 16-bit pilot per bucket of 4 strings as in PTHash.
+ *  Each slot keeps an 8-bit tag of the hash and the length of its string,
+ *  and strings are stored in the order of the slots with the offset of
+ *  every 16th slot, ie. 3 bytes per string: most absent strings are
+ *  rejected without reading any string, and a present one is compared
+ *  once. An optional blocked Bloom filter rejects absent strings reading a
+ *  single cache line.
+ */
+  class StringSet
+  {
+  public:
+    static const size_t npos = (size_t) -1;
+
+    StringSet (void);
+
+    void add (const char * s, const size_t & len);
+    void add (const std::string & s) { add (s.data(), s.size()); }
+    void build (const size_t & bloomBits = 0);
+    size_t find (const char * s, const size_t & len) const;
+    size_t find (const std::string & s) const
+    {
+      return find (s.data(), s.size());
+    }
+    bool contains (const char * s, const size_t & len) const
+    {
+      return find(s, len) != npos;
+    }
+    bool contains (const std::string & s) const { return find(s) != npos; }
+    size_t size (void) const { return size_; }
+    size_t nbSlots (void) const { return slots_.size(); }
+    size_t memory (void) const;
+    void clear (void);
+
+  private:
+    struct Slot
+    {
+      uint8_t tag; // 0 if empty
+      uint8_t len; // 255 if the string starts with its length on 4 bytes
+    };
+
+    bool findPilots (std::vector<uint64_t> & hashes);
+    bool placeStrings (void);
+    size_t getSlot (const uint64_t & hash) const;
+
+    uint64_t seed_;
+    size_t size_, nbAdded_, nbBloomHashes_;
+    std::vector<char> arena_; // as added with their length, then by slot
+    std::vector<uint16_t> pilots_;
+    std::vector<Slot> slots_;
+    std::vector<uint64_t> offsets_; // in the arena, of every 16th slot
+    std::vector<uint64_t> bloom_; // blocks of 512 bits
+  };
+
+/** \brief Set of numbers keeping the order in which they were first
+ *  inserted, with an open-addressing hash table giving the position of any
+ *  of them in O(1).
+ */
+  class SizeIndex
+  {
+  public:
+    static const size_t npos = (size_t) -1;
+
+    SizeIndex (void);
+
+    size_t insert (const size_t & key, bool & isNew);
+    size_t find (const size_t & key) const;
+    bool contains (const size_t & key) const { return find(key) != npos; }
+    size_t size (void) const { return keys_.size(); }
+    size_t key (const size_t & i) const { return keys_[i]; }
+    const std::vector<size_t> & keys (void) const { return keys_; }
+    void clear (void);
+
+  private:
+    size_t findSlot (const size_t & key) const;
+    void rehash (const size_t & nbSlots);
+
+    std::vector<size_t> keys_;
+    std::vector<uint32_t> slots_; // 0 if empty, position + 1 otherwise
+  };
+
+/** \brief Where the records of a tab-delimited file are, as in tabix.
+ *  \note Columns are numbered from 1, and colEnd is 0 when records are one
+ *  base long. Positions start from 0 with the end excluded, as in BED, or
+ *  from 1 with the end included. Lines starting with meta, and the first
+ *  skip lines, aren't records.
+ */
+  struct TabixFormat
+  {
+    uint32_t colSeq, colBeg, colEnd;
+    bool isZeroBased;
+    char meta;
+    uint32_t skip;
+    DelimSet delims;
+  };
+
+  constexpr TabixFormat TABIX_BED = {1, 2, 3, true, '#', 0, DELIMS_TAB};
+  constexpr TabixFormat TABIX_SNPANNOT = {3, 2, 0, false, '#', 0,
+					  DELIMS_WHITESPACE}; // impute2bimbam
+  constexpr TabixFormat TABIX_IMPUTE = {1, 3, 0, false, '#', 0,
+					DELIMS_WHITESPACE};
+
+/** \brief Index of the records of a BGZF file sorted by position, giving
+ *  the blocks to read to find those overlapping a region.
+ *  \note This is the binning scheme of tabix: each record is put in the
+ *  smallest of 37449 bins that contains it, at 6 levels from 512 Mb to
+ *  16 kb, with the ranges of virtual offsets of its records, and a linear
+ *  index keeps the first record overlapping each 16 kb window. The index
+ *  is saved as <file>.tbi, in the format of tabix, without the delimiters
+ *  which tabix takes to be tabs.
+ */
+  class TabixIndex
+  {
+  public:
+    static const uint64_t npos = (uint64_t) -1;
+
+    struct Chunk
+    {
+      uint64_t beg, end; // virtual offsets
+    };
+
+    TabixIndex (void);
+
+    void open (const std::string & pathToFile,
+	       const TabixFormat & format = TABIX_BED);
+    void build (const std::string & pathToFile,
+		const TabixFormat & format = TABIX_BED);
+    bool load (const std::string & pathToFile,
+	       const TabixFormat & format = TABIX_BED);
+    void save (void) const;
+    void clear (void);
+
+    bool parseRecord (const char * line, const size_t & len, Field & seq,
+		      uint64_t & beg, uint64_t & end) const;
+    size_t findSeq (const char * seq, const size_t & len) const
+    {
+      return names_.find (seq, len);
+    }
+    size_t findSeq (const std::string & seq) const
+    {
+      return names_.find (seq);
+    }
+    void findChunks (const size_t & seqId, const uint64_t & beg,
+		     const uint64_t & end, std::vector<Chunk> & chunks) const;
+    size_t nbSeqs (void) const { return names_.size(); }
+    const TabixFormat & format (void) const { return format_; }
+    const std::string & path (void) const { return path_; }
+    static std::string getPath (const std::string & pathToFile)
+    {
+      return pathToFile + ".tbi";
+    }
+
+  private:
+    struct Seq
+    {
+      std::map<uint32_t, std::vector<Chunk> > bins;
+      std::vector<uint64_t> linear; // first offset of each 16 kb window
+    };
+
+    std::string path_;
+    TabixFormat format_;
+    StringIndex names_;
+    std::vector<Seq> seqs_;
+  };
+
+  bool parseRegion (const std::string & region, std::string & seq,
+		    uint64_t & beg, uint64_t & end);
+
+/** \brief Read the records of a BGZF file overlapping a region, in the
+ *  order of the file, inflating only the blocks of the chunks given by its
+ *  tabix index.
+ *  \note The last blocks inflated are kept, as the chunks of the largest
+ *  bins are read again for nearby regions.
+ */
+  class RegionReader
+  {
+  public:
+    RegionReader (void);
+    RegionReader (const std::string & pathToFile, const TabixIndex & index);
+    ~RegionReader (void);
+
+    void open (const std::string & pathToFile, const TabixIndex & index);
+    bool seek (const size_t & seqId, const uint64_t & beg,
+	       const uint64_t & end);
+    bool seek (const std::string & region);
+    bool getline (const char * & line, size_t & len);
+    bool getline (const char * & line, size_t & len, uint64_t & beg,
+		  uint64_t & end);
+    void close (void);
+    bool isOpen (void) const { return file_ != NULL; }
+
+  private:
+    RegionReader (const RegionReader &);
+    RegionReader & operator= (const RegionReader &);
+    void loadBlock (const uint64_t offset);
+    bool readLine (const char * & line, size_t & len);
+    uint64_t tell (void);
+
+    struct Block
+    {
+      std::vector<char> data; // inflated
+      uint64_t next; // offset of the next block in the file, npos if none
+    };
+
+    std::string path_;
+    const TabixIndex * index_;
+    FILE * file_;
+    z_stream strm_;
+    std::vector<TabixIndex::Chunk> chunks_;
+    size_t chunk_; // being read
+    size_t seqId_;
+    uint64_t beg_, end_; // of the region
+    std::vector<char> in_;
+    std::map<uint64_t, Block> cache_; // by offset in the file
+    std::deque<uint64_t> cached_; // in the order they were inflated
+    const Block * block_;
+    uint64_t blockOffset_;
+    size_t pos_; // in the inflated block
+    std::string line_; // over several blocks
+  };
+
   std::vector<size_t> getCounters (const size_t & nbIterations,
 			      const size_t & nbSteps);
 